@@ -3,392 +3,2806 @@
  * Functions descriptions are found below.
  */
 
-#include "Trailblazer.h"
+#include "Pathfinding_Algorithms.h"
+#include "error.h"
 #include "queue.h"
 #include "map.h"
-#include "pqueue.h"
 #include "set.h"
+#include "hashmap.h"
+#include "grid.h"
 #include <cfloat>
+#include <climits>
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <fstream>
+#include <iomanip>
+#include <memory>
+#include <mutex>
+#include <ostream>
+#include <string>
+#include <thread>
+#include <vector>
+#ifndef _WIN32
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
 
 using namespace std;
 
 
+/* Monotone radix heap (bucket queue) keyed by node ID, for costs that are integer
+ * multiples of a fixed resolution (e.g. travel times in whole seconds). Priorities are
+ * quantized to integers and placed in one of 65 buckets by the highest bit in which they
+ * differ from the last key popped, so push, decrease-key and pop cost amortized O(1) per
+ * bit instead of a log-n sift. Keys must never drop below the last key popped, which holds
+ * for Dijkstra and for A* with a consistent heuristic.
+ */
+class RadixHeap {
+public:
+    RadixHeap(double costResolution) : resolution(costResolution) {}
+
+    bool isEmpty() const {
+        return count == 0;
+    }
+
+    int size() const {
+        return count;
+    }
+
+    //inserts id with the given priority, or lowers its priority if it is already queued
+    void pushOrDecrease(int id, double priority) {
+        uint64_t key = uint64_t(llround(priority/resolution));
+        if (key < lastKey) key = lastKey;
+        if (id >= int(keys.size())) {
+            keys.resize(id+1);
+            bucketOf.resize(id+1,kNotQueued);
+            slotOf.resize(id+1);
+        }
+        if (bucketOf[id] != kNotQueued) {
+            if (key >= keys[id]) return;
+            unlink(id);
+        } else {
+            count++;
+        }
+        keys[id] = key;
+        link(id,bucketFor(key));
+    }
+
+    //removes and returns an ID with the lowest quantized priority
+    int popMin() {
+        if (buckets[0].empty()) {
+            int first = 1;
+            while (buckets[first].empty()) first++;
+
+            //the smallest key in the first non-empty bucket becomes the new reference,
+            //and every entry of that bucket moves to a strictly lower bucket
+            uint64_t newLast = UINT64_MAX;
+            for (int id : buckets[first]) newLast = min(newLast, keys[id]);
+            lastKey = newLast;
+            vector<int> moving;
+            moving.swap(buckets[first]);
+            for (int id : moving) link(id,bucketFor(keys[id]));
+        }
+        int id = buckets[0].back();
+        buckets[0].pop_back();
+        bucketOf[id] = kNotQueued;
+        count--;
+        return id;
+    }
+
+private:
+    static const int kNumBuckets = 65;
+
+    double resolution;
+    uint64_t lastKey = 0;
+    int count = 0;
+    vector<int> buckets[kNumBuckets];
+    vector<uint64_t> keys;      //quantized priority for each node ID
+    vector<int> bucketOf;       //bucket holding each node ID, kNotQueued if absent
+    vector<int> slotOf;         //index of each node ID inside its bucket
+
+    int bucketFor(uint64_t key) const {
+        uint64_t diff = key ^ lastKey;
+        int bucket = 0;
+        while (diff != 0) {
+            bucket++;
+            diff >>= 1;
+        }
+        return bucket;
+    }
+
+    void link(int id, int bucket) {
+        bucketOf[id] = bucket;
+        slotOf[id] = buckets[bucket].size();
+        buckets[bucket].push_back(id);
+    }
+
+    void unlink(int id) {
+        vector<int>& bucket = buckets[bucketOf[id]];
+        int moved = bucket.back();
+        bucket[slotOf[id]] = moved;
+        slotOf[moved] = slotOf[id];
+        bucket.pop_back();
+    }
+};
+
+/* Barrier that the threads of a level-synchronous search wait at between levels (C++17
+ * has no std::barrier). It can be reused: every time the last of numThreads threads
+ * arrives, all of them are released and the barrier starts over.
+ */
+class LevelBarrier {
+public:
+    LevelBarrier(int numThreads) : numThreads(numThreads) {}
+
+    void wait() {
+        unique_lock<mutex> guard(lock);
+        uint64_t arrivedIn = phase;
+        if (++numArrived == numThreads) {
+            numArrived = 0;
+            phase++;
+            released.notify_all();
+            return;
+        }
+        released.wait(guard,[&] { return phase != arrivedIn; });
+    }
+
+private:
+    mutex lock;
+    condition_variable released;
+    int numThreads;
+    int numArrived = 0;
+    uint64_t phase = 0;
+};
+
+/* Observer used by the RoadGraph entry points: colors reached nodes yellow and settled
+ * nodes green, as the assignment's visualizer expects.
+ */
+class ColoringObserver : public SearchObserver {
+public:
+    ColoringObserver(const RoadGraphSnapshot& snapshot) : snapshot(snapshot) {}
+
+    void nodeReached(int id) override {
+        snapshot.nodes[id]->setColor(Color::YELLOW);
+    }
+
+    void nodeSettled(int id) override {
+        snapshot.nodes[id]->setColor(Color::GREEN);
+    }
+
+private:
+    const RoadGraphSnapshot& snapshot;
+};
+
+/* Counts one search's work while it runs and charges it to its context's stats and
+ * histogram when it goes out of scope. Searches create one at the start, bump the
+ * counters in counts as they go and call startPhase when they move from setup to the
+ * main loop and from the main loop to rebuilding the path. A search that runs in two
+ * contexts at once (bidirectional, contraction hierarchy) passes the second one as other:
+ * its buffers count too, and the whole search is charged once, to context. Clocks are
+ * only read if the context has stats or a histogram attached.
+ */
+class SearchRecorder {
+public:
+    SearchRecorder(SearchContext& context, SearchContext* other = nullptr);
+    ~SearchRecorder();
+
+    void startPhase();
+
+    void frontierSize(long long size) {
+        counts.peakFrontier = max(counts.peakFrontier,size);
+    }
+
+    SearchStats counts;
+
+private:
+    size_t bufferBytes() const;
+
+    SearchContext& context;
+    SearchContext* other;
+    bool isTimed;
+    int phase = 0;
+    size_t bytesBefore;
+    chrono::steady_clock::time_point phaseStart;
+};
+
+/* Gathers the searches of a query that runs several in turn (alternativeRoutes runs a
+ * bidirectional search and then two bounded trees) into one sample. While it lives, the
+ * searches in forward and backward record into its own counts; when it goes out of scope
+ * the sum is charged to forward's stats and histogram as a single search.
+ */
+class QueryRecorder {
+public:
+    QueryRecorder(SearchContext& forward, SearchContext& backward);
+    ~QueryRecorder();
+
+private:
+    SearchContext& forward;
+    SearchContext& backward;
+    SearchStats* stats;
+    SearchStatsHistogram* histogram;
+    SearchStats* backwardStats;
+    SearchStatsHistogram* backwardHistogram;
+    SearchStats counts;
+};
+
+enum SearchMode { BREADTH_FIRST, DIJKSTRA, A_STAR };
+
+/* A forward and a backward context kept by one thread between queries through the
+ * RoadGraph entry points (see ColoringQuery). snapshot is the snapshot they were built
+ * over; it is only watched, not held, so a snapshot dropped from the cache is freed as
+ * usual and the contexts are rebuilt by the next query.
+ */
+struct QueryContexts {
+    weak_ptr<const RoadGraphSnapshot> snapshot;
+    unique_ptr<SearchContext> forward;
+    unique_ptr<SearchContext> backward;
+    bool isInUse = false;
+};
+
+/* Search state for one query through the RoadGraph entry points: the graph's cached
+ * snapshot, held for as long as the query runs, and a forward and a backward context over
+ * it that color nodes for the visualizer (unless colorsNodes is false) and record into
+ * whatever recordSearchStats set up for the graph. The contexts are the calling thread's
+ * QueryContexts, reused by every query on the same snapshot, so starting a query only
+ * bumps their generations; queries on other threads use their own. A query started while
+ * another is running on the same thread (from an observer, say) gets a fresh pair.
+ */
+class ColoringQuery {
+public:
+    ColoringQuery(const RoadGraph& graph, bool colorsNodes = true);
+    ~ColoringQuery();
+    ColoringQuery(const ColoringQuery&) = delete;
+    ColoringQuery& operator=(const ColoringQuery&) = delete;
+
+    shared_ptr<const RoadGraphSnapshot> snapshot;
+    ColoringObserver observer;
+
+private:
+    unique_ptr<QueryContexts> ownContexts;
+    QueryContexts& contexts;
+
+public:
+    SearchContext& forward;
+    SearchContext& backward;
+};
+
+/* Snapshots of the graphs searched through the RoadGraph entry points, and where
+ * recordSearchStats asked their searches to record, by graph. Every access goes through
+ * lock; snapshots are handed out as shared pointers, so one that is dropped from the
+ * cache stays alive until the queries using it are done.
+ */
+struct SnapshotCache {
+    mutex lock;
+    HashMap<const RoadGraph*,shared_ptr<const RoadGraphSnapshot>> snapshots;
+    HashMap<const RoadGraph*,SearchStats*> stats;
+    HashMap<const RoadGraph*,SearchStatsHistogram*> histograms;
+};
+
+
 //Prototypes of helper functions. Look how many I have!
-double nodeCost(const RoadGraph& graph, const Path& path);
+void buildReverseEdges(RoadGraphSnapshot& snapshot);
+int reverseEdgeOf(const RoadGraphSnapshot& snapshot, int from, int e);
+
+SnapshotCache& snapshotCache();
+
+void attachRecording(const RoadGraph& graph, SearchContext& context);
+
+QueryContexts& queryContextsFor(const shared_ptr<const RoadGraphSnapshot>& snapshot,
+                                unique_ptr<QueryContexts>& ownContexts);
+
+void growShortestPathTree(SearchContext& context, int source, bool backward,
+                          const vector<char>* targets = nullptr, int numTargets = 0);
+
+vector<int> growBoundedTree(SearchContext& context, int source, bool backward, double maxCost);
+
+vector<int> runContractionHierarchySearch(const ContractionHierarchy& hierarchy,
+                                          SearchContext& forward, SearchContext& backward,
+                                          int start, int end, double* pathCost);
+
+vector<int> growUpwardSearch(const ContractionHierarchy& hierarchy, SearchContext& context,
+                             int source, bool backward);
+
+void unpackArc(const ContractionHierarchy& hierarchy, int from, int to, vector<int>& path);
+
+vector<vector<int>> runAlternativeSearch(SearchContext& forward, SearchContext& backward,
+                                         int startId, int endId,
+                                         int numAlternatives, double minUniqueFraction,
+                                         double maxStretch);
+
+vector<int> runSearch(SearchContext& context, int start, int end,
+                      SearchMode mode, double* pathCost = nullptr);
+
+vector<int> runHopSearch(SearchContext& context, int start, int end);
+
+vector<int> runDirectionOptimizingSearch(SearchContext& context, int start, int end,
+                                         int numThreads);
+
+template <typename Frontier>
+vector<int> runCostSearch(SearchContext& context, int start, int end, SearchMode mode,
+                          Frontier& frontier, double* pathCost);
+
+vector<int> runBidirectionalSearch(SearchContext& forward, SearchContext& backward,
+                                   int start, int end, bool usePotentials, double* pathCost);
+
+vector<int> runTimeDependentSearch(SearchContext& context, const TravelTimeProfiles& profiles,
+                                   int start, int end, double departureTime, SearchMode mode,
+                                   double* arrivalTime);
+
+Path toPath(const RoadGraphSnapshot& snapshot, const vector<int>& ids);
+
+
+/* This function uses the Breadth-First Search algorithm to find shortest path
+ * from start node to end node. This algorithm has no knowledge of edge cost, so
+ * it defines the "shortest" path as the path with elast number of hops
+ */
+Path breadthFirstSearch(const RoadGraph& graph, RoadNode* start, RoadNode* end) {
+    ColoringQuery query(graph);
+    return breadthFirstSearch(query.forward,start,end);
+}
+
+Path breadthFirstSearch(SearchContext& context, RoadNode* start, RoadNode* end) {
+    const RoadGraphSnapshot& snapshot = context.snapshot;
+    return toPath(snapshot,breadthFirstSearch(context,snapshot.idOf(start),snapshot.idOf(end)));
+}
+
+vector<int> breadthFirstSearch(SearchContext& context, int start, int end) {
+    return runSearch(context,start,end,BREADTH_FIRST);
+}
+
+
+/* This function uses the Dijkstra's algorithm to find shortest path
+ * from start node to end node. This algorithm takes edge cost into account,
+ * but has no knowledge of the overall shape of the map
+ */
+Path dijkstrasAlgorithm(const RoadGraph& graph, RoadNode* start, RoadNode* end) {
+    ColoringQuery query(graph);
+    return dijkstrasAlgorithm(query.forward,start,end);
+}
+
+Path dijkstrasAlgorithm(SearchContext& context, RoadNode* start, RoadNode* end) {
+    const RoadGraphSnapshot& snapshot = context.snapshot;
+    return toPath(snapshot,dijkstrasAlgorithm(context,snapshot.idOf(start),snapshot.idOf(end)));
+}
+
+vector<int> dijkstrasAlgorithm(SearchContext& context, int start, int end, double* pathCost) {
+    return runSearch(context,start,end,DIJKSTRA,pathCost);
+}
+
+
+/* This function uses the A* Search algorithm to find shortest path
+ * from start node to end node. This algorithm takes edge cost and map knowedledge
+ * into account, and is therefore, faster than two previous algorithms
+ */
+Path aStar(const RoadGraph& graph, RoadNode* start, RoadNode* end) {
+    ColoringQuery query(graph);
+    return aStar(query.forward,start,end);
+}
+
+Path aStar(SearchContext& context, RoadNode* start, RoadNode* end) {
+    const RoadGraphSnapshot& snapshot = context.snapshot;
+    return toPath(snapshot,aStar(context,snapshot.idOf(start),snapshot.idOf(end)));
+}
+
+vector<int> aStar(SearchContext& context, int start, int end, double* pathCost) {
+    return runSearch(context,start,end,A_STAR,pathCost);
+}
+
+
+/* A* guided by landmark (ALT) lower bounds as well as crow-fly distance. The landmarks
+ * must have been built for (or loaded against) the snapshot of this graph.
+ */
+Path aStar(const RoadGraph& graph, RoadNode* start, RoadNode* end,
+           const LandmarkTable& landmarks) {
+    ColoringQuery query(graph);
+    query.forward.landmarks = &landmarks;
+    return aStar(query.forward,start,end);
+}
+
+
+/* Dijkstra's algorithm on a radix heap (bucket queue) instead of a comparison heap.
+ * Path costs are ordered in whole multiples of costResolution, so the result is optimal
+ * whenever every edge cost is a multiple of costResolution (e.g. travel times rounded to
+ * whole seconds) and within one costResolution per hop otherwise.
+ */
+Path dijkstrasAlgorithmBucketed(const RoadGraph& graph, RoadNode* start, RoadNode* end,
+                                double costResolution) {
+    ColoringQuery query(graph);
+    SearchContext& context = query.forward;
+    const RoadGraphSnapshot& snapshot = context.snapshot;
+    RadixHeap frontier(costResolution);
+    return toPath(snapshot,runCostSearch(context,snapshot.idOf(start),snapshot.idOf(end),
+                                         DIJKSTRA,frontier,nullptr));
+}
+
+/* Hop-count search for large unweighted graphs: finds a path with as few hops as
+ * breadthFirstSearch does, without coloring anything. The graph is explored level by
+ * level with a visited bitmap and a parent array. While the frontier is small, each level
+ * is expanded top-down (frontier nodes claim their unvisited neighbors); once the
+ * frontier's edges outnumber the edges left to explore by kBottomUpFactor, it switches to
+ * bottom-up (each unvisited node looks for a parent in the frontier, stopping at the first
+ * one), and back to top-down when the frontier shrinks below 1/kTopDownFactor of the
+ * nodes. With numThreads > 1 every level is split between that many threads; the path
+ * then may differ from run to run, but never in length.
+ */
+Path breadthFirstSearchDirectionOptimizing(const RoadGraph& graph, RoadNode* start,
+                                           RoadNode* end, int numThreads) {
+    ColoringQuery query(graph,false);
+    const RoadGraphSnapshot& snapshot = *query.snapshot;
+    return toPath(snapshot,runDirectionOptimizingSearch(query.forward,snapshot.idOf(start),
+                                                        snapshot.idOf(end),numThreads));
+}
+
+
+
+/* Bidirectional version of Dijkstra's algorithm: one search grows from the start node and
+ * one grows backward from the end node, and the search stops once no path through the
+ * two frontiers can beat the best meeting point found so far. Returns a path of the same
+ * (optimal) cost as dijkstrasAlgorithm while settling far fewer nodes on long routes.
+ */
+Path bidirectionalDijkstra(const RoadGraph& graph, RoadNode* start, RoadNode* end) {
+    ColoringQuery query(graph);
+    return bidirectionalDijkstra(query.forward,query.backward,start,end);
+}
+
+Path bidirectionalDijkstra(SearchContext& forward, SearchContext& backward,
+                           RoadNode* start, RoadNode* end) {
+    const RoadGraphSnapshot& snapshot = forward.snapshot;
+    return toPath(snapshot,bidirectionalDijkstra(forward,backward,snapshot.idOf(start),
+                                                 snapshot.idOf(end)));
+}
+
+vector<int> bidirectionalDijkstra(SearchContext& forward, SearchContext& backward,
+                                  int start, int end, double* pathCost) {
+    return runBidirectionalSearch(forward,backward,start,end,false,pathCost);
+}
+
+
+/* Bidirectional version of the A* Search algorithm. Both searches are guided by the same
+ * "average" potential (half the heuristic toward the end minus half the heuristic toward
+ * the start), which keeps the two searches consistent with each other so the result is
+ * still optimal.
+ */
+Path bidirectionalAStar(const RoadGraph& graph, RoadNode* start, RoadNode* end) {
+    ColoringQuery query(graph);
+    return bidirectionalAStar(query.forward,query.backward,start,end);
+}
+
+Path bidirectionalAStar(SearchContext& forward, SearchContext& backward,
+                        RoadNode* start, RoadNode* end) {
+    const RoadGraphSnapshot& snapshot = forward.snapshot;
+    return toPath(snapshot,bidirectionalAStar(forward,backward,snapshot.idOf(start),
+                                              snapshot.idOf(end)));
+}
+
+vector<int> bidirectionalAStar(SearchContext& forward, SearchContext& backward,
+                               int start, int end, double* pathCost) {
+    return runBidirectionalSearch(forward,backward,start,end,true,pathCost);
+}
+
+
+/* Point-to-point query on a contraction hierarchy built by buildContractionHierarchy (or
+ * loaded from disk) for this graph. Returns the same optimal-cost route as
+ * dijkstrasAlgorithm, with shortcuts unpacked back into the original roads.
+ */
+Path contractionHierarchyQuery(const RoadGraph& graph, const ContractionHierarchy& hierarchy,
+                               RoadNode* start, RoadNode* end) {
+    ColoringQuery query(graph);
+    return contractionHierarchyQuery(hierarchy,query.forward,query.backward,start,end);
+}
+
+Path contractionHierarchyQuery(const ContractionHierarchy& hierarchy, SearchContext& forward,
+                               SearchContext& backward, RoadNode* start, RoadNode* end) {
+    const RoadGraphSnapshot& snapshot = forward.snapshot;
+    return toPath(snapshot,contractionHierarchyQuery(hierarchy,forward,backward,
+                                                     snapshot.idOf(start),snapshot.idOf(end)));
+}
+
+vector<int> contractionHierarchyQuery(const ContractionHierarchy& hierarchy,
+                                      SearchContext& forward, SearchContext& backward,
+                                      int start, int end, double* pathCost) {
+    return runContractionHierarchySearch(hierarchy,forward,backward,start,end,pathCost);
+}
+
+/* Travel-cost matrix between every source and every target: entry (i,j) is the cost of
+ * the cheapest path from sources[i] to targets[j], DBL_MAX if there is none. Runs one
+ * Dijkstra search per source (or, if there are fewer targets, one backward search per
+ * target), all in the same context, each stopping as soon as every node on the other
+ * side is settled. If paths is given, it is resized to match and filled with the paths
+ * themselves (empty where there is none). Nothing is colored.
+ */
+Grid<double> distanceMatrix(const RoadGraph& graph, const Vector<RoadNode*>& sources,
+                            const Vector<RoadNode*>& targets, Grid<Path>* paths) {
+    ColoringQuery query(graph,false);
+    return distanceMatrix(query.forward,sources,targets,paths);
+}
+
+Grid<double> distanceMatrix(SearchContext& context, const Vector<RoadNode*>& sources,
+                            const Vector<RoadNode*>& targets, Grid<Path>* paths) {
+
+    const RoadGraphSnapshot& snapshot = context.snapshot;
+    Grid<double> costs(sources.size(),targets.size(),DBL_MAX);
+    if (paths != nullptr) paths->resize(sources.size(),targets.size());
+
+    //search from the smaller side; backward trees still lead from each source to its target
+    bool backward = targets.size() < sources.size();
+    const Vector<RoadNode*>& roots = backward ? targets : sources;
+    const Vector<RoadNode*>& leaves = backward ? sources : targets;
+
+    vector<char> isLeaf(snapshot.numNodes(),false);
+    int numLeaves = 0;
+    for (RoadNode* leaf : leaves) {
+        int leafId = snapshot.idOf(leaf);
+        if (!isLeaf[leafId]) numLeaves++;
+        isLeaf[leafId] = true;
+    }
+    if (numLeaves == 0) return costs;
+
+    for (int i = 0; i < roots.size(); ++i) {
+        growShortestPathTree(context,snapshot.idOf(roots[i]),backward,&isLeaf,numLeaves);
+
+        for (int j = 0; j < leaves.size(); ++j) {
+            int leafId = snapshot.idOf(leaves[j]);
+            if (!context.isReached(leafId)) continue;
+            int row = backward ? j : i;
+            int col = backward ? i : j;
+            costs.set(row,col,context.gScore[leafId]);
+            if (paths == nullptr) continue;
+
+            vector<int> ids = context.pathTo(leafId);
+            if (backward) reverse(ids.begin(),ids.end());
+            paths->set(row,col,toPath(snapshot,ids));
+        }
+    }
+    return costs;
+}
+
+
+/* Travel-cost matrix (as above) on a contraction hierarchy, using buckets: a backward
+ * upward search from every target leaves an entry (target, cost) in a bucket at each node
+ * it settles, then a forward upward search from every source scans the buckets of the
+ * nodes it settles. Each entry found is a meeting point, so every source and every target
+ * costs one small search instead of a pair costing one. Costs only; use the plain version
+ * above for paths.
+ */
+Grid<double> distanceMatrix(const RoadGraph& graph, const ContractionHierarchy& hierarchy,
+                            const Vector<RoadNode*>& sources, const Vector<RoadNode*>& targets) {
+    ColoringQuery query(graph,false);
+    return distanceMatrix(hierarchy,query.forward,sources,targets);
+}
+
+Grid<double> distanceMatrix(const ContractionHierarchy& hierarchy, SearchContext& context,
+                            const Vector<RoadNode*>& sources, const Vector<RoadNode*>& targets) {
+
+    const RoadGraphSnapshot& snapshot = context.snapshot;
+    Grid<double> costs(sources.size(),targets.size(),DBL_MAX);
+
+    //bucket entries, first collected per target and then grouped by node
+    vector<int> entryNode;
+    vector<int> entryTarget;
+    vector<double> entryCost;
+    for (int j = 0; j < targets.size(); ++j) {
+        for (int v : growUpwardSearch(hierarchy,context,snapshot.idOf(targets[j]),true)) {
+            entryNode.push_back(v);
+            entryTarget.push_back(j);
+            entryCost.push_back(context.gScore[v]);
+        }
+    }
+
+    vector<int> firstEntry(snapshot.numNodes() + 1,0);
+    for (int v : entryNode) {
+        firstEntry[v+1]++;
+    }
+    for (int v = 0; v < snapshot.numNodes(); ++v) {
+        firstEntry[v+1] += firstEntry[v];
+    }
+    vector<int> bucketTarget(entryNode.size());
+    vector<double> bucketCost(entryNode.size());
+    vector<int> nextEntry(firstEntry.begin(),firstEntry.end() - 1);
+    for (size_t k = 0; k < entryNode.size(); ++k) {
+        int slot = nextEntry[entryNode[k]]++;
+        bucketTarget[slot] = entryTarget[k];
+        bucketCost[slot] = entryCost[k];
+    }
+
+    for (int i = 0; i < sources.size(); ++i) {
+        for (int v : growUpwardSearch(hierarchy,context,snapshot.idOf(sources[i]),false)) {
+            double sourceCost = context.gScore[v];
+            for (int k = firstEntry[v]; k < firstEntry[v+1]; ++k) {
+                double viaCost = sourceCost + bucketCost[k];
+                if (viaCost < costs.get(i,bucketTarget[k])) costs.set(i,bucketTarget[k],viaCost);
+            }
+        }
+    }
+    return costs;
+}
+
+/* Has every search run on graph through the RoadGraph entry points above
+ * (breadthFirstSearch, dijkstrasAlgorithm, aStar, alternativeRoute, ...) add its work to
+ * stats and histogram. Each query counts as one search, even those that run several
+ * inside (bidirectional searches, contraction hierarchies, alternativeRoute); the
+ * matrices count one per tree they grow. Either may be null; pass both as null to stop
+ * recording. Neither is locked, so record only while queries on the graph come one at a
+ * time.
+ */
+void recordSearchStats(const RoadGraph& graph, SearchStats* stats,
+                       SearchStatsHistogram* histogram) {
+    SnapshotCache& cache = snapshotCache();
+    lock_guard<mutex> guard(cache.lock);
+    cache.stats.put(&graph,stats);
+    cache.histograms.put(&graph,histogram);
+}
+
+/* Time-dependent versions of Dijkstra's algorithm and A*: leaving start at departureTime,
+ * finds the route that arrives at end earliest when edges with a profile take the travel
+ * time their profile gives for the moment they are entered. The arrival time is written
+ * to arrivalTime (DBL_MAX if end cannot be reached) when it is given. The profiles must
+ * have been made for the snapshot searched (for the RoadGraph versions, snapshotOf(graph)
+ * as it is now, not one dropped by forgetSnapshot since); it is an error otherwise.
+ */
+Path timeDependentDijkstra(const RoadGraph& graph, const TravelTimeProfiles& profiles,
+                           RoadNode* start, RoadNode* end, double departureTime,
+                           double* arrivalTime) {
+    ColoringQuery query(graph);
+    return timeDependentDijkstra(query.forward,profiles,start,end,departureTime,arrivalTime);
+}
+
+Path timeDependentDijkstra(SearchContext& context, const TravelTimeProfiles& profiles,
+                           RoadNode* start, RoadNode* end, double departureTime,
+                           double* arrivalTime) {
+    const RoadGraphSnapshot& snapshot = context.snapshot;
+    return toPath(snapshot,runTimeDependentSearch(context,profiles,snapshot.idOf(start),
+                                                  snapshot.idOf(end),departureTime,DIJKSTRA,
+                                                  arrivalTime));
+}
+
+Path timeDependentAStar(const RoadGraph& graph, const TravelTimeProfiles& profiles,
+                        RoadNode* start, RoadNode* end, double departureTime,
+                        double* arrivalTime) {
+    ColoringQuery query(graph);
+    return timeDependentAStar(query.forward,profiles,start,end,departureTime,arrivalTime);
+}
+
+Path timeDependentAStar(SearchContext& context, const TravelTimeProfiles& profiles,
+                        RoadNode* start, RoadNode* end, double departureTime,
+                        double* arrivalTime) {
+    const RoadGraphSnapshot& snapshot = context.snapshot;
+    return toPath(snapshot,runTimeDependentSearch(context,profiles,snapshot.idOf(start),
+                                                  snapshot.idOf(end),departureTime,A_STAR,
+                                                  arrivalTime));
+}
+
+
+/* Applies a batch of new static edge costs (e.g. from a traffic feed) to a snapshot, in
+ * both its outgoing and incoming edge arrays, and returns what actually changed so that
+ * cached trees can be repaired with ShortestPathTree::repair. Edges that do not exist are
+ * skipped. Contexts, trees and profiles over the snapshot stay valid; landmark tables and
+ * contraction hierarchies built from it do not, and have to be rebuilt.
+ */
+vector<EdgeCostChange> updateEdgeCosts(RoadGraphSnapshot& snapshot,
+                                       const vector<SnapshotEdge>& newCosts) {
+    vector<EdgeCostChange> changes;
+    for (const SnapshotEdge& update : newCosts) {
+        int e = snapshot.edgeBetween(update.from,update.to);
+        if (e == kNoEdge || snapshot.edgeCost[e] == update.cost) continue;
+        changes.push_back({update.from,update.to,e,snapshot.edgeCost[e],update.cost});
+        snapshot.inEdgeCost[reverseEdgeOf(snapshot,update.from,e)] = update.cost;
+        snapshot.edgeCost[e] = update.cost;
+    }
+    return changes;
+}
+
+
+
+/* Starts numThreads workers (one per hardware thread if numThreads is 0 or less), each
+ * with its own pair of search contexts over a snapshot of graph taken now.
+ */
+RouteQueryExecutor::RouteQueryExecutor(const RoadGraph& graph, int numThreads)
+    : snapshot(buildSnapshot(graph)) {
+    if (numThreads <= 0) numThreads = max(1u,thread::hardware_concurrency());
+    for (int i = 0; i < numThreads; ++i) {
+        forwardContexts.emplace_back(new SearchContext(snapshot));
+        backwardContexts.emplace_back(new SearchContext(snapshot));
+    }
+    for (int i = 0; i < numThreads; ++i) {
+        workers.emplace_back(&RouteQueryExecutor::workerLoop,this,i);
+    }
+}
+
+RouteQueryExecutor::~RouteQueryExecutor() {
+    {
+        lock_guard<mutex> guard(lock);
+        isStopping = true;
+    }
+    batchReady.notify_all();
+    for (thread& worker : workers) {
+        worker.join();
+    }
+}
+
+
+//answers every request in the batch and returns the paths in the same order
+Vector<Path> RouteQueryExecutor::run(const Vector<RouteRequest>& requests) {
+    {
+        lock_guard<mutex> guard(lock);
+        batch = &requests;
+        answers.assign(requests.size(),Path());
+        nextRequest = 0;
+        busyWorkers = workers.size();
+        batchNumber++;
+    }
+    batchReady.notify_all();
+
+    unique_lock<mutex> guard(lock);
+    batchDone.wait(guard,[&] { return busyWorkers == 0; });
+    batch = nullptr;
+
+    Vector<Path> paths;
+    for (Path& path : answers) {
+        paths += path;
+    }
+    answers.clear();
+    return paths;
+}
+
+
+//waits for each batch, then takes requests from it until none are left
+void RouteQueryExecutor::workerLoop(int worker) {
+    SearchContext& forward = *forwardContexts[worker];
+    SearchContext& backward = *backwardContexts[worker];
+    uint64_t lastBatch = 0;
+
+    while (true) {
+        {
+            unique_lock<mutex> guard(lock);
+            batchReady.wait(guard,[&] { return isStopping || batchNumber != lastBatch; });
+            if (isStopping) return;
+            lastBatch = batchNumber;
+        }
+
+        for (int i = nextRequest++; i < batch->size(); i = nextRequest++) {
+            const RouteRequest& request = (*batch)[i];
+            switch (request.algorithm) {
+            case BREADTH_FIRST_ROUTE:
+                answers[i] = breadthFirstSearch(forward,request.start,request.end);
+                break;
+            case DIJKSTRA_ROUTE:
+                answers[i] = dijkstrasAlgorithm(forward,request.start,request.end);
+                break;
+            case A_STAR_ROUTE:
+                answers[i] = aStar(forward,request.start,request.end);
+                break;
+            case ALTERNATIVE_ROUTE:
+                answers[i] = alternativeRoute(forward,backward,request.start,request.end);
+                break;
+            }
+        }
+
+        {
+            lock_guard<mutex> guard(lock);
+            if (--busyWorkers == 0) batchDone.notify_one();
+        }
+    }
+}
+
+
+
+
+/* This function finds an alternative to the shortest/main path (see alternativeRoutes
+ * below): the cheapest route that shares less than 80% of its nodes with the main path
+ * and costs at most kMaxAlternativeStretch times as much. Returns an empty path if there
+ * is no such route, including when every route different enough costs more than that;
+ * call alternativeRoutes with a larger maxStretch to look further.
+ */
+Path alternativeRoute(const RoadGraph& graph, RoadNode* start, RoadNode* end) {
+    Vector<Path> routes = alternativeRoutes(graph,start,end,1,kMinUniqueFraction);
+    return routes.isEmpty() ? Path() : routes[0];
+}
+
+Path alternativeRoute(SearchContext& forward, SearchContext& backward,
+                      RoadNode* start, RoadNode* end) {
+    Vector<Path> routes = alternativeRoutes(forward,backward,start,end,1,kMinUniqueFraction);
+    return routes.isEmpty() ? Path() : routes[0];
+}
+
+
+/* Finds up to numAlternatives alternatives to the shortest path from start to end, cheapest
+ * first, using only a few searches. Once the optimal cost d is known, one shortest-path
+ * tree grows forward from start and one backward from end, each only as far as
+ * maxStretch*d; every node v settled by both is a candidate "via node", whose route is
+ * the tree path start..v followed by the tree path v..end, at cost d(start,v) +
+ * d(v,end). Candidates costing at most maxStretch*d are tried in order of
+ * that cost. A route is accepted if it visits no node twice and at least
+ * minUniqueFraction of its nodes lie on neither the main path nor any alternative
+ * accepted before it.
+ */
+Vector<Path> alternativeRoutes(const RoadGraph& graph, RoadNode* start, RoadNode* end,
+                               int numAlternatives, double minUniqueFraction,
+                               double maxStretch) {
+    ColoringQuery query(graph);
+    return alternativeRoutes(query.forward,query.backward,start,end,numAlternatives,
+                             minUniqueFraction,maxStretch);
+}
+
+Vector<Path> alternativeRoutes(SearchContext& forward, SearchContext& backward,
+                               RoadNode* start, RoadNode* end,
+                               int numAlternatives, double minUniqueFraction,
+                               double maxStretch) {
+    const RoadGraphSnapshot& snapshot = forward.snapshot;
+    Vector<Path> routes;
+    for (const vector<int>& ids : alternativeRoutes(forward,backward,snapshot.idOf(start),
+                                                    snapshot.idOf(end),numAlternatives,
+                                                    minUniqueFraction,maxStretch)) {
+        routes += toPath(snapshot,ids);
+    }
+    return routes;
+}
+
+vector<vector<int>> alternativeRoutes(SearchContext& forward, SearchContext& backward,
+                                      int start, int end, int numAlternatives,
+                                      double minUniqueFraction, double maxStretch) {
+    return runAlternativeSearch(forward,backward,start,end,numAlternatives,minUniqueFraction,
+                                maxStretch);
+}
+
+
+//via-node search behind alternativeRoutes, on snapshot node IDs
+vector<vector<int>> runAlternativeSearch(SearchContext& forward, SearchContext& backward,
+                                         int startId, int endId,
+                                         int numAlternatives, double minUniqueFraction,
+                                         double maxStretch) {
+
+    vector<vector<int>> routes;
+    if (startId == endId) return routes;
+    QueryRecorder recorder(forward,backward);
+    double optimalCost;
+    runBidirectionalSearch(forward,backward,startId,endId,false,&optimalCost);
+    if (optimalCost == DBL_MAX) return routes;
+    double maxCost = maxStretch*optimalCost;
+
+    growBoundedTree(forward,startId,false,maxCost);
+    vector<int> candidates;
+    for (int v : growBoundedTree(backward,endId,true,maxCost)) {
+        if (forward.isSettled(v) && forward.gScore[v] + backward.gScore[v] <= maxCost) {
+            candidates.push_back(v);
+        }
+    }
+
+    //via node candidates, cheapest route first
+    auto viaCost = [&](int v) {
+        return forward.gScore[v] + backward.gScore[v];
+    };
+    stable_sort(candidates.begin(),candidates.end(),
+                [&](int a, int b) { return viaCost(a) < viaCost(b); });
+
+    //nodes of the main path and of each accepted alternative, sorted for lookups
+    vector<vector<int>> acceptedNodes;
+    vector<int> mainIds = forward.pathTo(endId);
+    acceptedNodes.push_back(mainIds);
+    sort(acceptedNodes.back().begin(),acceptedNodes.back().end());
+
+    //via nodes on the main path only lead back to the main path
+    uint32_t tried = backward.newMark();
+    for (int id : mainIds) {
+        backward.markStamp[id] = tried;
+    }
+
+    for (int via : candidates) {
+        if (int(routes.size()) >= numAlternatives) break;
+        if (backward.markStamp[via] == tried) continue;
+        backward.markStamp[via] = tried;
+
+        vector<int> routeIds = forward.pathTo(via);
+        for (int curr = backward.parent[via]; curr != kNoParent; curr = backward.parent[curr]) {
+            routeIds.push_back(curr);
+        }
+
+        //reject routes that loop back on themselves
+        uint32_t seen = forward.newMark();
+        bool isSimple = true;
+        for (int id : routeIds) {
+            if (forward.markStamp[id] == seen) {
+                isSimple = false;
+                break;
+            }
+            forward.markStamp[id] = seen;
+        }
+        if (!isSimple) continue;
+
+        //count nodes found on no route accepted so far
+        int numUniqueNodes = 0;
+        for (int id : routeIds) {
+            bool isShared = false;
+            for (const vector<int>& nodes : acceptedNodes) {
+                if (binary_search(nodes.begin(),nodes.end(),id)) {
+                    isShared = true;
+                    break;
+                }
+            }
+            if (!isShared) numUniqueNodes++;
+        }
+        if (double(numUniqueNodes)/double(routeIds.size()) < minUniqueFraction) continue;
+
+        routes.push_back(routeIds);
+        acceptedNodes.push_back(routeIds);
+        sort(acceptedNodes.back().begin(),acceptedNodes.back().end());
+    }
+    return routes;
+}
+
+
+/* Shared entry point behind all of the algorithms above, working on snapshot node IDs and
+ * returning the IDs along the path found (empty if there is none). BREADTH_FIRST expands
+ * nodes in hop order, DIJKSTRA in order of g-score and A_STAR in order of g-score plus
+ * heuristic; the cost-ordered modes use the context's indexed 4-ary heap as their
+ * frontier. The cost of the path found is written to pathCost (DBL_MAX if there is no
+ * path) when pathCost is given.
+ */
+vector<int> runSearch(SearchContext& context, int start, int end,
+                      SearchMode mode, double* pathCost) {
+    if (mode == BREADTH_FIRST) {
+        return runHopSearch(context,start,end);
+    }
+    context.frontier.clear();
+    return runCostSearch(context,start,end,mode,context.frontier,pathCost);
+}
+
+
+/* Breadth-first search loop. Every node is enqueued once, the first time it is reached,
+ * and remembers the node it was reached from; the path is rebuilt once the end node is
+ * dequeued.
+ */
+vector<int> runHopSearch(SearchContext& context, int start, int end) {
+
+    //edge case
+    if (start==end){
+        return {start};
+    }
+
+    const RoadGraphSnapshot& snapshot = context.snapshot;
+    SearchRecorder recorder(context);
+    SearchStats& counts = recorder.counts;
+    context.beginQuery(end);
+    Queue<int> myHopQueue;
+
+    //mark start node as reached
+    context.markReached(start,kNoParent,0.0);
+    myHopQueue.enqueue(start);
+    recorder.startPhase();
+
+    while(!myHopQueue.isEmpty()) {
+
+        int lastId = myHopQueue.dequeue();
+        context.markSettled(lastId);
+        counts.heapPops++;
+        counts.nodesSettled++;
+
+        //test if we've reached our destination
+        if (lastId == end) {
+            recorder.startPhase();
+            return context.pathTo(lastId);
+        }
+
+        for (int e = snapshot.firstEdge[lastId]; e < snapshot.firstEdge[lastId+1]; ++e) {
+            int eachId = snapshot.edgeTarget[e];
+            counts.edgesRelaxed++;
+
+            //only if they have not been reached yet
+            if (!context.isReached(eachId)) {
+                context.markReached(eachId,lastId,0.0);
+                myHopQueue.enqueue(eachId);
+                counts.heapPushes++;
+            }
+        }
+        recorder.frontierSize(myHopQueue.size());
+    }
+    return {};
+}
+
+/* Level-synchronous loop behind breadthFirstSearchDirectionOptimizing. Each of the
+ * numThreads threads (the calling thread is thread 0) expands its share of a level into
+ * its own list of newly visited nodes: a slice of the frontier top-down, or a range of
+ * whole bitmap words bottom-up. Top-down, two threads may race for the same node, so
+ * visited bits are claimed with an atomic fetch_or; bottom-up, each node is only ever
+ * written by the thread owning its word. Between levels thread 0 gathers the lists into
+ * the next frontier and picks the direction of the next level. The context is only used
+ * for its snapshot and to record the search; the bitmaps and parents are local.
+ */
+vector<int> runDirectionOptimizingSearch(SearchContext& context, int start, int end,
+                                         int numThreads) {
+
+    //edge case
+    if (start==end){
+        return {start};
+    }
+
+    const RoadGraphSnapshot& snapshot = context.snapshot;
+    SearchRecorder recorder(context);
+    SearchStats& counts = recorder.counts;
+    const int kBottomUpFactor = 14;
+    const int kTopDownFactor = 24;
+    int numNodes = snapshot.numNodes();
+    int numWords = (numNodes + 63)/64;
+    numThreads = max(1,numThreads);
+
+    unique_ptr<atomic<uint64_t>[]> visited(new atomic<uint64_t>[numWords]);
+    vector<uint64_t> inFrontier(numWords,0);
+    for (int w = 0; w < numWords; ++w) {
+        visited[w].store(0,memory_order_relaxed);
+    }
+    vector<int> parent(numNodes);
+    counts.bytesAllocated = numWords*(sizeof(atomic<uint64_t>) + sizeof(uint64_t))
+                            + numNodes*sizeof(int);
+    auto isVisited = [&](int id) {
+        return (visited[id/64].load(memory_order_relaxed) >> (id%64)) & 1;
+    };
+
+    //edges into unvisited nodes, i.e. the work a bottom-up level may have to do
+    long long edgesUnexplored = snapshot.inEdgeSource.size();
+    vector<int> frontier = {start};
+    long long frontierEdges = snapshot.firstEdge[start+1] - snapshot.firstEdge[start];
+    edgesUnexplored -= snapshot.firstInEdge[start+1] - snapshot.firstInEdge[start];
+    visited[start/64].fetch_or(uint64_t(1) << (start%64),memory_order_relaxed);
+    parent[start] = kNoParent;
+
+    bool isBottomUp = false;
+    bool isDone = false;
+    vector<vector<int>> newlyVisited(numThreads);
+    vector<long long> edgesLookedAt(numThreads,0);
+    LevelBarrier barrier(numThreads);
+    counts.nodesSettled = 1;
+    recorder.startPhase();
+
+    auto expandLevels = [&](int t) {
+        while (true) {
+            vector<int>& found = newlyVisited[t];
+            found.clear();
+            long long numEdges = 0;
+
+            if (isBottomUp) {
+                for (int w = numWords*t/numThreads; w < numWords*(t + 1)/numThreads; ++w) {
+                    uint64_t word = visited[w].load(memory_order_relaxed);
+                    for (int bit = 0; bit < 64 && w*64 + bit < numNodes; ++bit) {
+                        if ((word >> bit) & 1) continue;
+                        int id = w*64 + bit;
+                        for (int e = snapshot.firstInEdge[id]; e < snapshot.firstInEdge[id+1]; ++e) {
+                            int fromId = snapshot.inEdgeSource[e];
+                            numEdges++;
+                            if ((inFrontier[fromId/64] >> (fromId%64)) & 1) {
+                                word |= uint64_t(1) << bit;
+                                parent[id] = fromId;
+                                found.push_back(id);
+                                break;
+                            }
+                        }
+                    }
+                    visited[w].store(word,memory_order_relaxed);
+                }
+            } else {
+                size_t sliceBegin = frontier.size()*t/numThreads;
+                size_t sliceEnd = frontier.size()*(t + 1)/numThreads;
+                for (size_t i = sliceBegin; i < sliceEnd; ++i) {
+                    int lastId = frontier[i];
+                    numEdges += snapshot.firstEdge[lastId+1] - snapshot.firstEdge[lastId];
+                    for (int e = snapshot.firstEdge[lastId]; e < snapshot.firstEdge[lastId+1]; ++e) {
+                        int eachId = snapshot.edgeTarget[e];
+                        if (isVisited(eachId)) continue;
+                        uint64_t bit = uint64_t(1) << (eachId%64);
+                        if (visited[eachId/64].fetch_or(bit,memory_order_relaxed) & bit) continue;
+                        parent[eachId] = lastId;
+                        found.push_back(eachId);
+                    }
+                }
+            }
+            edgesLookedAt[t] += numEdges;
+            barrier.wait();
+
+            if (t == 0) {
+                if (isBottomUp) {
+                    for (int id : frontier) {
+                        inFrontier[id/64] = 0;
+                    }
+                }
+                frontier.clear();
+                frontierEdges = 0;
+                for (const vector<int>& ids : newlyVisited) {
+                    for (int id : ids) {
+                        frontier.push_back(id);
+                        frontierEdges += snapshot.firstEdge[id+1] - snapshot.firstEdge[id];
+                        edgesUnexplored -= snapshot.firstInEdge[id+1] - snapshot.firstInEdge[id];
+                    }
+                }
+                isDone = frontier.empty() || isVisited(end);
+                counts.nodesSettled += frontier.size();
+                recorder.frontierSize(frontier.size());
+
+                if (!isBottomUp && frontierEdges > edgesUnexplored/kBottomUpFactor) {
+                    isBottomUp = true;
+                } else if (isBottomUp && frontier.size() < size_t(numNodes/kTopDownFactor)) {
+                    isBottomUp = false;
+                }
+                if (isBottomUp) {
+                    for (int id : frontier) {
+                        inFrontier[id/64] |= uint64_t(1) << (id%64);
+                    }
+                }
+            }
+            barrier.wait();
+            if (isDone) return;
+        }
+    };
+
+    vector<thread> helpers;
+    for (int t = 1; t < numThreads; ++t) {
+        helpers.emplace_back(expandLevels,t);
+    }
+    expandLevels(0);
+    for (thread& helper : helpers) {
+        helper.join();
+    }
+    for (long long numEdges : edgesLookedAt) {
+        counts.edgesRelaxed += numEdges;
+    }
+
+    if (!isVisited(end)) return {};
+    recorder.startPhase();
+    int hops = 0;
+    for (int curr = end; curr != kNoParent; curr = parent[curr]) {
+        hops++;
+    }
+    vector<int> path(hops);
+    for (int curr = end; curr != kNoParent; curr = parent[curr]) {
+        path[--hops] = curr;
+    }
+    return path;
+}
+
+
+
+/* Dijkstra / A* search loop, generic over the frontier (IndexedHeap or RadixHeap). The
+ * frontier holds each reached node once; relaxing a neighbor adds a single edge cost to
+ * the current node's g-score, and whenever a neighbor is reached more cheaply than before
+ * its predecessor and g-score are overwritten and its frontier priority is decreased in
+ * place. The path is rebuilt once, when the end node is popped.
+ */
+template <typename Frontier>
+vector<int> runCostSearch(SearchContext& context, int start, int end, SearchMode mode,
+                          Frontier& frontier, double* pathCost) {
+
+    if (pathCost != nullptr) *pathCost = DBL_MAX;
+
+    //edge case
+    if (start==end){
+        if (pathCost != nullptr) *pathCost = 0.0;
+        return {start};
+    }
+
+    const RoadGraphSnapshot& snapshot = context.snapshot;
+    SearchRecorder recorder(context);
+    SearchStats& counts = recorder.counts;
+    context.beginQuery(end);
+
+    //mark start node as reached
+    context.markReached(start,kNoParent,0.0);
+    frontier.pushOrDecrease(start,0.0);
+    recorder.startPhase();
+
+    while(!frontier.isEmpty()) {
+
+        int lastId = frontier.popMin();
+        double lastCost = context.gScore[lastId];
+        context.markSettled(lastId);
+        counts.heapPops++;
+        counts.nodesSettled++;
+
+        if (lastId == end) {
+            if (pathCost != nullptr) *pathCost = lastCost;
+            recorder.startPhase();
+            return context.pathTo(lastId);
+        }
+
+        //loop through node's outgoing edges
+        for (int e = snapshot.firstEdge[lastId]; e < snapshot.firstEdge[lastId+1]; ++e) {
+            int eachId = snapshot.edgeTarget[e];
+            counts.edgesRelaxed++;
+
+            //only if they are not settled
+            if (context.isSettled(eachId)) continue;
+
+            //keep only the cheapest way of reaching each node
+            double newCost = lastCost + snapshot.edgeCost[e];
+            if (newCost >= context.costTo(eachId)) continue;
+            context.markReached(eachId,lastId,newCost);
+
+            //queue node using distance (PLUS HEURISTIC for A*) as priority
+            double priority = newCost;
+            if (mode == A_STAR) {
+                priority += context.heuristic(eachId);
+            }
+            frontier.pushOrDecrease(eachId,priority);
+            counts.heapPushes++;
+        }
+        recorder.frontierSize(frontier.size());
+    }
+    return {};
+}
+
+
+/* Bidirectional search loop behind bidirectionalDijkstra and bidirectionalAStar. The
+ * forward context searches out of start over outgoing edges and the backward context
+ * searches out of end over incoming edges; each step expands the side with the smaller
+ * frontier. Every edge relaxed into a node the other side has reached is a candidate
+ * meeting point. With usePotentials, priorities are shifted by the average potential
+ * p(v) = (h(v,end) - h(v,start))/2 forward and -p(v) backward; either way the search may
+ * stop as soon as the two smallest priorities add up to at least the best meeting cost.
+ */
+vector<int> runBidirectionalSearch(SearchContext& forward, SearchContext& backward,
+                                   int start, int end, bool usePotentials, double* pathCost) {
+
+    if (pathCost != nullptr) *pathCost = DBL_MAX;
+
+    //edge case
+    if (start==end){
+        if (pathCost != nullptr) *pathCost = 0.0;
+        return {start};
+    }
+
+    const RoadGraphSnapshot& snapshot = forward.snapshot;
+    SearchRecorder recorder(forward,&backward);
+    SearchStats& counts = recorder.counts;
+    forward.searchesBackward = false;
+    backward.searchesBackward = true;
+    forward.beginQuery(end);
+    backward.beginQuery(start);
+    forward.frontier.clear();
+    backward.frontier.clear();
+
+    auto potential = [&](int id) -> double {
+        if (!usePotentials) return 0.0;
+        return (forward.heuristic(id) - backward.heuristic(id))/2.0;
+    };
+
+    forward.markReached(start,kNoParent,0.0);
+    forward.frontier.pushOrDecrease(start,potential(start));
+    backward.markReached(end,kNoParent,0.0);
+    backward.frontier.pushOrDecrease(end,-potential(end));
+    recorder.startPhase();
+
+    double bestCost = DBL_MAX;
+    int meetingNode = kNoParent;
+
+    while (!forward.frontier.isEmpty() && !backward.frontier.isEmpty()) {
+
+        //no unexplored path can be cheaper than the best meeting point
+        if (forward.frontier.minPriority() + backward.frontier.minPriority() >= bestCost) break;
+
+        bool isForward = forward.frontier.size() <= backward.frontier.size();
+        SearchContext& self = isForward ? forward : backward;
+        SearchContext& other = isForward ? backward : forward;
+        const vector<int>& first = isForward ? snapshot.firstEdge : snapshot.firstInEdge;
+        const vector<int>& target = isForward ? snapshot.edgeTarget : snapshot.inEdgeSource;
+        const vector<double>& cost = isForward ? snapshot.edgeCost : snapshot.inEdgeCost;
+
+        int lastId = self.frontier.popMin();
+        double lastCost = self.gScore[lastId];
+        self.markSettled(lastId);
+        counts.heapPops++;
+        counts.nodesSettled++;
+
+        for (int e = first[lastId]; e < first[lastId+1]; ++e) {
+            int eachId = target[e];
+            double newCost = lastCost + cost[e];
+            counts.edgesRelaxed++;
+
+            //the two searches meet at eachId
+            if (other.isReached(eachId) && newCost + other.gScore[eachId] < bestCost) {
+                bestCost = newCost + other.gScore[eachId];
+                meetingNode = eachId;
+            }
+
+            if (self.isSettled(eachId) || newCost >= self.costTo(eachId)) continue;
+            self.markReached(eachId,lastId,newCost);
+            self.frontier.pushOrDecrease(eachId,newCost + (isForward ? potential(eachId)
+                                                                     : -potential(eachId)));
+            counts.heapPushes++;
+        }
+        recorder.frontierSize(forward.frontier.size() + backward.frontier.size());
+    }
+
+    if (meetingNode == kNoParent) return {};
+    recorder.startPhase();
+    if (pathCost != nullptr) *pathCost = bestCost;
+
+    //forward half runs start..meetingNode; backward predecessors lead on toward end
+    vector<int> path = forward.pathTo(meetingNode);
+    for (int curr = backward.parent[meetingNode]; curr != kNoParent; curr = backward.parent[curr]) {
+        path.push_back(curr);
+    }
+    return path;
+}
+
+/* Search loop behind timeDependentDijkstra and timeDependentAStar. Like runCostSearch,
+ * but g-scores are travel times from departureTime and the cost of an edge is looked up
+ * for the time the search gets to its tail. The A* estimate is the crow-fly heuristic
+ * scaled by profiles.heuristicScale; landmarks are ignored, since their distances were
+ * measured with static costs.
+ */
+vector<int> runTimeDependentSearch(SearchContext& context, const TravelTimeProfiles& profiles,
+                                   int start, int end, double departureTime, SearchMode mode,
+                                   double* arrivalTime) {
+
+    //profiles are indexed by snapshot edge, so they only fit the snapshot they were made for
+    if (&profiles.snapshot != &context.snapshot) {
+        error("time-dependent search: the travel time profiles were made for another snapshot");
+    }
+    if (arrivalTime != nullptr) *arrivalTime = DBL_MAX;
+
+    //edge case
+    if (start==end){
+        if (arrivalTime != nullptr) *arrivalTime = departureTime;
+        return {start};
+    }
+
+    const RoadGraphSnapshot& snapshot = context.snapshot;
+    SearchRecorder recorder(context);
+    SearchStats& counts = recorder.counts;
+    context.beginQuery(end);
+    context.frontier.clear();
+    context.markReached(start,kNoParent,0.0);
+    context.frontier.pushOrDecrease(start,0.0);
+    recorder.startPhase();
+
+    while (!context.frontier.isEmpty()) {
+
+        int lastId = context.frontier.popMin();
+        double lastCost = context.gScore[lastId];
+        context.markSettled(lastId);
+        counts.heapPops++;
+        counts.nodesSettled++;
+
+        if (lastId == end) {
+            if (arrivalTime != nullptr) *arrivalTime = departureTime + lastCost;
+            recorder.startPhase();
+            return context.pathTo(lastId);
+        }
+
+        for (int e = snapshot.firstEdge[lastId]; e < snapshot.firstEdge[lastId+1]; ++e) {
+            int eachId = snapshot.edgeTarget[e];
+            counts.edgesRelaxed++;
+            if (context.isSettled(eachId)) continue;
+
+            double newCost = lastCost + profiles.travelTime(e,departureTime + lastCost);
+            if (newCost >= context.costTo(eachId)) continue;
+            context.markReached(eachId,lastId,newCost);
+
+            double priority = newCost;
+            if (mode == A_STAR) {
+                priority += profiles.heuristicScale*snapshot.heuristic(eachId,end);
+            }
+            context.frontier.pushOrDecrease(eachId,priority);
+            counts.heapPushes++;
+        }
+        recorder.frontierSize(context.frontier.size());
+    }
+    return {};
+}
 
-double nodeHeuristic(const RoadGraph& graph, RoadNode* current, RoadNode* end);
 
-Vector<RoadEdge*> getEdges(const RoadGraph& graph, const Path& path);
 
-bool isTwentyUnique(Path mainPath, Path altPath);
+/* Runs Dijkstra's algorithm from source until every reachable node is settled, following
+ * outgoing edges (or incoming edges if backward is set). Afterwards context.costTo(v) is
+ * the cost from source to v (from v to source if backward) and context.parent holds the
+ * shortest-path tree. If targets is given, the search stops early once numTargets of the
+ * nodes flagged in it are settled; the tree is then only complete around those nodes.
+ */
+void growShortestPathTree(SearchContext& context, int source, bool backward,
+                          const vector<char>* targets, int numTargets) {
+    const RoadGraphSnapshot& snapshot = context.snapshot;
+    const vector<int>& first = backward ? snapshot.firstInEdge : snapshot.firstEdge;
+    const vector<int>& target = backward ? snapshot.inEdgeSource : snapshot.edgeTarget;
+    const vector<double>& cost = backward ? snapshot.inEdgeCost : snapshot.edgeCost;
+
+    SearchRecorder recorder(context);
+    SearchStats& counts = recorder.counts;
+    context.beginQuery(source);
+    context.frontier.clear();
+    context.markReached(source,kNoParent,0.0);
+    context.frontier.pushOrDecrease(source,0.0);
+    recorder.startPhase();
+
+    while (!context.frontier.isEmpty()) {
+        int lastId = context.frontier.popMin();
+        double lastCost = context.gScore[lastId];
+        context.markSettled(lastId);
+        counts.heapPops++;
+        counts.nodesSettled++;
+        if (targets != nullptr && (*targets)[lastId] && --numTargets == 0) return;
+
+        for (int e = first[lastId]; e < first[lastId+1]; ++e) {
+            int eachId = target[e];
+            double newCost = lastCost + cost[e];
+            counts.edgesRelaxed++;
+            if (context.isSettled(eachId) || newCost >= context.costTo(eachId)) continue;
+            context.markReached(eachId,lastId,newCost);
+            context.frontier.pushOrDecrease(eachId,newCost);
+            counts.heapPushes++;
+        }
+        recorder.frontierSize(context.frontier.size());
+    }
+}
 
-Path alternativeRouteEdge(const RoadGraph& graph, RoadNode* start, RoadNode* end,
-                          RoadEdge* edgeToExclude);
 
+/* Like growShortestPathTree, but settles only the nodes that cost at most maxCost from
+ * (or, if backward is set, to) source, and returns them in the order they were settled.
+ */
+vector<int> growBoundedTree(SearchContext& context, int source, bool backward, double maxCost) {
+    const RoadGraphSnapshot& snapshot = context.snapshot;
+    const vector<int>& first = backward ? snapshot.firstInEdge : snapshot.firstEdge;
+    const vector<int>& target = backward ? snapshot.inEdgeSource : snapshot.edgeTarget;
+    const vector<double>& cost = backward ? snapshot.inEdgeCost : snapshot.edgeCost;
+
+    SearchRecorder recorder(context);
+    SearchStats& counts = recorder.counts;
+    context.beginQuery(source);
+    context.frontier.clear();
+    context.markReached(source,kNoParent,0.0);
+    context.frontier.pushOrDecrease(source,0.0);
+    recorder.startPhase();
+
+    vector<int> settled;
+    while (!context.frontier.isEmpty() && context.frontier.minPriority() <= maxCost) {
+        int lastId = context.frontier.popMin();
+        double lastCost = context.gScore[lastId];
+        context.markSettled(lastId);
+        settled.push_back(lastId);
+        counts.heapPops++;
+        counts.nodesSettled++;
+
+        for (int e = first[lastId]; e < first[lastId+1]; ++e) {
+            int eachId = target[e];
+            double newCost = lastCost + cost[e];
+            counts.edgesRelaxed++;
+            if (context.isSettled(eachId) || newCost >= context.costTo(eachId)) continue;
+            context.markReached(eachId,lastId,newCost);
+            context.frontier.pushOrDecrease(eachId,newCost);
+            counts.heapPushes++;
+        }
+        recorder.frontierSize(context.frontier.size());
+    }
+    return settled;
+}
 
-/* This function uses the Breadth-First Search algorithm to find shortest path
- * from start node to end node. This algorithm has no knowledge of edge cost, so
- * it defines the "shortest" path as the path with elast number of hops
+
+/* ALT preprocessing: picks numLandmarks landmarks by farthest selection and records the
+ * cost from each landmark to every node and from every node back to it. The first
+ * landmark is the node farthest from node 0; each further landmark is the reachable node
+ * whose distance to its closest landmark so far is largest, which spreads landmarks out
+ * toward the edges of the map where they give the tightest bounds.
  */
-Path breadthFirstSearch(const RoadGraph& graph, RoadNode* start, RoadNode* end) {
+LandmarkTable buildLandmarks(const RoadGraphSnapshot& snapshot, int numLandmarks) {
+    LandmarkTable table;
+    int numNodes = snapshot.numNodes();
+    table.numNodes = numNodes;
+    table.graphFingerprint = fingerprintOf(snapshot);
+    if (numNodes == 0) return table;
+
+    numLandmarks = min(numLandmarks,numNodes);
+    table.fromLandmark.assign(size_t(numNodes)*numLandmarks,DBL_MAX);
+    table.toLandmark.assign(size_t(numNodes)*numLandmarks,DBL_MAX);
+
+    SearchContext context(snapshot);
+    vector<double> closestLandmark(numNodes,DBL_MAX);
+
+    //seed farthest selection with a search from node 0
+    growShortestPathTree(context,0,false);
+    for (int v = 0; v < numNodes; ++v) {
+        closestLandmark[v] = context.costTo(v);
+    }
 
-    //edge case
-    if (start==end){
-        return {start};
+    for (int i = 0; i < numLandmarks; ++i) {
+
+        //farthest reachable node from the landmarks picked so far
+        int next = -1;
+        for (int v = 0; v < numNodes; ++v) {
+            if (closestLandmark[v] == DBL_MAX) continue;
+            if (next == -1 || closestLandmark[v] > closestLandmark[next]) next = v;
+        }
+        if (next == -1 || (i > 0 && closestLandmark[next] == 0.0)) break;
+        int slot = table.landmarks.size();
+        table.landmarks.push_back(next);
+
+        growShortestPathTree(context,next,false);
+        for (int v = 0; v < numNodes; ++v) {
+            double cost = context.costTo(v);
+            table.fromLandmark[size_t(v)*numLandmarks + slot] = cost;
+            closestLandmark[v] = (i == 0) ? cost : min(closestLandmark[v],cost);
+        }
+
+        growShortestPathTree(context,next,true);
+        for (int v = 0; v < numNodes; ++v) {
+            table.toLandmark[size_t(v)*numLandmarks + slot] = context.costTo(v);
+        }
+    }
+
+    //drop the unused columns if farthest selection ran out of candidates early
+    int numPicked = table.landmarks.size();
+    if (numPicked < numLandmarks) {
+        vector<double> fromPacked(size_t(numNodes)*numPicked);
+        vector<double> toPacked(size_t(numNodes)*numPicked);
+        for (int v = 0; v < numNodes; ++v) {
+            for (int i = 0; i < numPicked; ++i) {
+                fromPacked[size_t(v)*numPicked + i] = table.fromLandmark[size_t(v)*numLandmarks + i];
+                toPacked[size_t(v)*numPicked + i] = table.toLandmark[size_t(v)*numLandmarks + i];
+            }
+        }
+        table.fromLandmark.swap(fromPacked);
+        table.toLandmark.swap(toPacked);
+    }
+    return table;
+}
+
+
+//ALT lower bound on the cost from one node to another (0 if no landmark says anything)
+double LandmarkTable::lowerBound(int from, int to) const {
+    int k = landmarks.size();
+    if (k == 0) return 0.0;     //an empty (or failed to load) table has no rows to index
+    const double* fromRowV = &fromLandmark[size_t(from)*k];
+    const double* fromRowT = &fromLandmark[size_t(to)*k];
+    const double* toRowV = &toLandmark[size_t(from)*k];
+    const double* toRowT = &toLandmark[size_t(to)*k];
+    double bound = 0.0;
+    for (int i = 0; i < k; ++i) {
+        if (fromRowV[i] != DBL_MAX && fromRowT[i] != DBL_MAX) {
+            bound = max(bound,fromRowT[i] - fromRowV[i]);
+        }
+        if (toRowV[i] != DBL_MAX && toRowT[i] != DBL_MAX) {
+            bound = max(bound,toRowV[i] - toRowT[i]);
+        }
     }
+    return bound;
+}
 
-    Queue<Path> myPaths;
-    Map<RoadNode*,string> myNodeColors;
 
-    //set node to yellow
-    start->setColor(Color::YELLOW);
-    myNodeColors[start] = "yellow";
+/* Writes the tables to a binary file: a "ALT1" tag, the node count, landmark count and
+ * graph fingerprint, then the landmark IDs and both tables. Returns false if the file
+ * could not be written.
+ */
+bool LandmarkTable::save(const string& fileName) const {
+    ofstream out(fileName,ios::binary);
+    if (!out) return false;
+    int32_t header[2] = {numNodes,int32_t(landmarks.size())};
+    out.write("ALT1",4);
+    out.write(reinterpret_cast<const char*>(header),sizeof(header));
+    out.write(reinterpret_cast<const char*>(&graphFingerprint),sizeof(graphFingerprint));
+    out.write(reinterpret_cast<const char*>(landmarks.data()),landmarks.size()*sizeof(int));
+    out.write(reinterpret_cast<const char*>(fromLandmark.data()),fromLandmark.size()*sizeof(double));
+    out.write(reinterpret_cast<const char*>(toLandmark.data()),toLandmark.size()*sizeof(double));
+    return bool(out);
+}
+
 
-    //create first path and enqueue start node
-    Path firstPath;
-    firstPath += start;
-    myPaths.enqueue(firstPath);
+/* Reads tables written by save. Returns false (leaving the table untouched) if the file
+ * is missing or damaged, or was built for a different graph than snapshot, in which case
+ * the caller should run buildLandmarks again.
+ */
+bool LandmarkTable::load(const RoadGraphSnapshot& snapshot, const string& fileName) {
+    ifstream in(fileName,ios::binary);
+    if (!in) return false;
+    char tag[4];
+    int32_t header[2];
+    uint64_t fingerprint;
+    in.read(tag,4);
+    in.read(reinterpret_cast<char*>(header),sizeof(header));
+    in.read(reinterpret_cast<char*>(&fingerprint),sizeof(fingerprint));
+    if (!in || string(tag,4) != "ALT1" || header[0] != snapshot.numNodes()
+            || header[1] < 0 || fingerprint != fingerprintOf(snapshot)) {
+        return false;
+    }
 
-    while(!myPaths.isEmpty()) {
+    LandmarkTable loaded;
+    loaded.numNodes = header[0];
+    loaded.graphFingerprint = fingerprint;
+    loaded.landmarks.resize(header[1]);
+    loaded.fromLandmark.resize(size_t(header[0])*header[1]);
+    loaded.toLandmark.resize(size_t(header[0])*header[1]);
+    in.read(reinterpret_cast<char*>(loaded.landmarks.data()),loaded.landmarks.size()*sizeof(int));
+    in.read(reinterpret_cast<char*>(loaded.fromLandmark.data()),loaded.fromLandmark.size()*sizeof(double));
+    in.read(reinterpret_cast<char*>(loaded.toLandmark.data()),loaded.toLandmark.size()*sizeof(double));
+    if (!in) return false;
+
+    *this = loaded;
+    return true;
+}
 
-        Path deqPath = myPaths.dequeue();
-        RoadNode* lastNode = deqPath[deqPath.size()-1];
-        lastNode->setColor(Color::GREEN);
-        myNodeColors[lastNode] = "green";
 
-        //test if we've reached our destination
-        if (lastNode == end) {
-            return deqPath;
+/* Hash of a snapshot's structure and edge costs (FNV-1a), stored alongside preprocessed
+ * data so that a file built for a different or since-modified graph is never used.
+ */
+uint64_t fingerprintOf(const RoadGraphSnapshot& snapshot) {
+    uint64_t hash = 1469598103934665603ULL;
+    auto mix = [&hash](uint64_t value) {
+        for (int i = 0; i < 8; ++i) {
+            hash ^= (value >> (8*i)) & 0xff;
+            hash *= 1099511628211ULL;
+        }
+    };
+    mix(snapshot.numNodes());
+    for (int offset : snapshot.firstEdge) mix(offset);
+    for (int target : snapshot.edgeTarget) mix(target);
+    for (double cost : snapshot.edgeCost) {
+        uint64_t bits;
+        memcpy(&bits,&cost,sizeof(bits));
+        mix(bits);
+    }
+    return hash;
+}
+
+
+/* Contraction hierarchy preprocessing. Nodes are contracted in order of priority =
+ * twice the edge difference (shortcuts the contraction would add minus arcs it
+ * removes) plus the number of already-contracted neighbors, which keeps the hierarchy
+ * sparse and spreads contraction evenly over the map. Priorities are updated lazily: the
+ * node popped from the queue is re-evaluated and put back if it is no longer the
+ * cheapest. Whether a shortcut u->w is needed is decided by a witness search, a Dijkstra
+ * from u that avoids the node being contracted and gives up after kMaxWitnessSettled
+ * nodes (giving up only ever adds a shortcut that was not strictly needed, never loses
+ * a path).
+ */
+ContractionHierarchy buildContractionHierarchy(const RoadGraphSnapshot& snapshot) {
+    const int kMaxWitnessSettled = 500;
+
+    struct Arc {
+        int node;
+        double cost;
+        int middle;
+    };
+
+    struct Shortcut {
+        int from;
+        int to;
+        double cost;
+    };
+
+    int numNodes = snapshot.numNodes();
+    vector<vector<Arc>> out(numNodes);
+    vector<vector<Arc>> in(numNodes);
+
+    //adds arc from->to, or lowers the cost of an existing parallel arc
+    auto addArc = [&](int from, int to, double cost, int middle) {
+        for (Arc& arc : out[from]) {
+            if (arc.node != to) continue;
+            if (arc.cost <= cost) return;
+            arc.cost = cost;
+            arc.middle = middle;
+            for (Arc& back : in[to]) {
+                if (back.node == from) {
+                    back.cost = cost;
+                    back.middle = middle;
+                }
+            }
+            return;
         }
+        out[from].push_back({to,cost,middle});
+        in[to].push_back({from,cost,middle});
+    };
 
-        //else, get node's neighbors and loop through them
-        auto neighbors = graph.neighborsOf(lastNode);
+    for (int v = 0; v < numNodes; ++v) {
+        for (int e = snapshot.firstEdge[v]; e < snapshot.firstEdge[v+1]; ++e) {
+            if (snapshot.edgeTarget[e] != v) addArc(v,snapshot.edgeTarget[e],snapshot.edgeCost[e],kNoParent);
+        }
+    }
 
-        for (RoadNode* eachNode : neighbors) {
+    vector<char> contracted(numNodes,false);
+    vector<int> rank(numNodes,0);
+    vector<int> contractedNeighbors(numNodes,0);
+    SearchContext witness(snapshot);
+
+    //targetStamp[w] == stamp marks w as a target of the current findShortcuts call (the
+    //same v is evaluated many times, so a fresh stamp is needed for every call)
+    vector<int> targetStamp(numNodes,0);
+    int stamp = 0;
+
+    //finds the shortcuts that contracting v would need
+    auto findShortcuts = [&](int v) -> vector<Shortcut> {
+        vector<Shortcut> shortcuts;
+        int numTargets = 0;
+        stamp++;
+        for (const Arc& outArc : out[v]) {
+            if (!contracted[outArc.node] && targetStamp[outArc.node] != stamp) {
+                targetStamp[outArc.node] = stamp;
+                numTargets++;
+            }
+        }
 
-            //only if they are not present in our Color Map (AKA, gray nodes)
-            if (myNodeColors.get(eachNode) == "") {
+        for (const Arc& inArc : in[v]) {
+            int u = inArc.node;
+            if (contracted[u]) continue;
 
-                //color neighbors yellow
-                eachNode->setColor(Color::YELLOW);
-                myNodeColors[eachNode] = "yellow";
+            double maxVia = -1.0;
+            for (const Arc& outArc : out[v]) {
+                if (!contracted[outArc.node] && outArc.node != u) {
+                    maxVia = max(maxVia,inArc.cost + outArc.cost);
+                }
+            }
+            if (maxVia < 0.0) continue;
+
+            //witness search from u in the remaining graph without v; done once every
+            //target is settled, the costs exceed every path through v, or the budget is spent
+            witness.beginQuery(u);
+            witness.frontier.clear();
+            witness.markReached(u,kNoParent,0.0);
+            witness.frontier.pushOrDecrease(u,0.0);
+            int numSettled = 0;
+            int targetsLeft = numTargets - (targetStamp[u] == stamp ? 1 : 0);
+            while (!witness.frontier.isEmpty() && numSettled < kMaxWitnessSettled && targetsLeft > 0) {
+                if (witness.frontier.minPriority() > maxVia) break;
+                int lastId = witness.frontier.popMin();
+                double lastCost = witness.gScore[lastId];
+                witness.markSettled(lastId);
+                numSettled++;
+                if (targetStamp[lastId] == stamp && lastId != u) targetsLeft--;
+                for (const Arc& arc : out[lastId]) {
+                    if (arc.node == v || contracted[arc.node]) continue;
+                    double newCost = lastCost + arc.cost;
+                    if (witness.isSettled(arc.node) || newCost >= witness.costTo(arc.node)) continue;
+                    witness.markReached(arc.node,lastId,newCost);
+                    witness.frontier.pushOrDecrease(arc.node,newCost);
+                }
+            }
 
-                //enqueue new paths containing yellow nodes
-                Path copyPath = deqPath;
-                copyPath+=eachNode;
-                myPaths.enqueue(copyPath);
+            for (const Arc& outArc : out[v]) {
+                int w = outArc.node;
+                if (contracted[w] || w == u) continue;
+                double via = inArc.cost + outArc.cost;
+                if (witness.costTo(w) <= via) continue;
+                shortcuts.push_back({u,w,via});
             }
         }
+        return shortcuts;
+    };
+
+    auto priorityOf = [&](int v, int numShortcuts) -> double {
+        int numRemoved = 0;
+        for (const Arc& arc : in[v]) if (!contracted[arc.node]) numRemoved++;
+        for (const Arc& arc : out[v]) if (!contracted[arc.node]) numRemoved++;
+        return 2*(numShortcuts - numRemoved) + contractedNeighbors[v];
+    };
+
+    IndexedHeap<> order;
+    for (int v = 0; v < numNodes; ++v) {
+        order.pushOrDecrease(v,priorityOf(v,findShortcuts(v).size()));
     }
-    return {};
+
+    int nextRank = 0;
+    while (!order.isEmpty()) {
+        int v = order.popMin();
+        vector<Shortcut> shortcuts = findShortcuts(v);
+        double priority = priorityOf(v,shortcuts.size());
+        if (!order.isEmpty() && priority > order.minPriority()) {
+            order.pushOrDecrease(v,priority);
+            continue;
+        }
+
+        for (const Shortcut& shortcut : shortcuts) {
+            addArc(shortcut.from,shortcut.to,shortcut.cost,v);
+        }
+        contracted[v] = true;
+        rank[v] = nextRank++;
+
+        //v's own lists keep its arcs (they become its up and down arcs); its neighbors
+        //drop them so later witness searches never scan contracted nodes
+        auto dropArcsTo = [v](vector<Arc>& arcs) {
+            arcs.erase(remove_if(arcs.begin(),arcs.end(),[v](const Arc& arc) {
+                return arc.node == v;
+            }),arcs.end());
+        };
+        for (const Arc& arc : in[v]) {
+            contractedNeighbors[arc.node]++;
+            dropArcsTo(out[arc.node]);
+        }
+        for (const Arc& arc : out[v]) {
+            contractedNeighbors[arc.node]++;
+            dropArcsTo(in[arc.node]);
+        }
+    }
+
+    //lay the upward and downward arcs out in one image (see ContractionHierarchy)
+    int numUp = 0;
+    int numDown = 0;
+    for (int v = 0; v < numNodes; ++v) {
+        for (const Arc& arc : out[v]) if (rank[arc.node] > rank[v]) numUp++;
+        for (const Arc& arc : in[v]) if (rank[arc.node] > rank[v]) numDown++;
+    }
+
+    size_t imageSize = 24 + sizeof(double)*(numUp + numDown)
+                     + sizeof(int32_t)*(numNodes + 2*(numNodes+1) + 2*numUp + 2*numDown);
+    vector<uint64_t> image((imageSize + 7)/8,0);
+    char* bytes = reinterpret_cast<char*>(image.data());
+    int32_t counts[3] = {numNodes,numUp,numDown};
+    uint64_t fingerprint = fingerprintOf(snapshot);
+    memcpy(bytes,"CH01",4);
+    memcpy(bytes+4,counts,sizeof(counts));
+    memcpy(bytes+16,&fingerprint,sizeof(fingerprint));
+
+    double* upCost = reinterpret_cast<double*>(bytes+24);
+    double* downCost = upCost + numUp;
+    int32_t* rankOut = reinterpret_cast<int32_t*>(downCost + numDown);
+    int32_t* upFirst = rankOut + numNodes;
+    int32_t* upTarget = upFirst + numNodes + 1;
+    int32_t* upMiddle = upTarget + numUp;
+    int32_t* downFirst = upMiddle + numUp;
+    int32_t* downSource = downFirst + numNodes + 1;
+    int32_t* downMiddle = downSource + numDown;
+
+    int up = 0;
+    int down = 0;
+    for (int v = 0; v < numNodes; ++v) {
+        rankOut[v] = rank[v];
+        upFirst[v] = up;
+        downFirst[v] = down;
+        for (const Arc& arc : out[v]) {
+            if (rank[arc.node] <= rank[v]) continue;
+            upTarget[up] = arc.node;
+            upMiddle[up] = arc.middle;
+            upCost[up++] = arc.cost;
+        }
+        for (const Arc& arc : in[v]) {
+            if (rank[arc.node] <= rank[v]) continue;
+            downSource[down] = arc.node;
+            downMiddle[down] = arc.middle;
+            downCost[down++] = arc.cost;
+        }
+    }
+    upFirst[numNodes] = up;
+    downFirst[numNodes] = down;
+
+    ContractionHierarchy hierarchy;
+    hierarchy.ownedImage.swap(image);
+    hierarchy.attach(reinterpret_cast<const char*>(hierarchy.ownedImage.data()),imageSize);
+    return hierarchy;
 }
 
 
-/* This function uses the Dijkstra's algorithm to find shortest path
- * from start node to end node. This algorithm takes edge cost into account,
- * but has no knowledge of the overall shape of the map
+/* Contraction hierarchy query: a forward search from start over up arcs and a backward
+ * search from end over down arcs, i.e. both climb the hierarchy. Each side stops once its
+ * smallest priority reaches the best meeting cost; the path through the best meeting
+ * node is then unpacked arc by arc into original edges.
  */
-Path dijkstrasAlgorithm(const RoadGraph& graph, RoadNode* start, RoadNode* end) {
+vector<int> runContractionHierarchySearch(const ContractionHierarchy& hierarchy,
+                                          SearchContext& forward, SearchContext& backward,
+                                          int start, int end, double* pathCost) {
+
+    if (pathCost != nullptr) *pathCost = DBL_MAX;
 
     //edge case
     if (start==end){
+        if (pathCost != nullptr) *pathCost = 0.0;
         return {start};
     }
 
-    //use pqueue
-    PriorityQueue<Path> myPaths;
-    Map<RoadNode*,string> myNodeColors;
+    SearchRecorder recorder(forward,&backward);
+    SearchStats& counts = recorder.counts;
+    forward.beginQuery(end);
+    backward.beginQuery(start);
+    forward.frontier.clear();
+    backward.frontier.clear();
+    forward.markReached(start,kNoParent,0.0);
+    forward.frontier.pushOrDecrease(start,0.0);
+    backward.markReached(end,kNoParent,0.0);
+    backward.frontier.pushOrDecrease(end,0.0);
+    recorder.startPhase();
+
+    double bestCost = DBL_MAX;
+    int meetingNode = kNoParent;
+    bool isForward = true;
+
+    while (true) {
+        bool forwardDone = forward.frontier.isEmpty() || forward.frontier.minPriority() >= bestCost;
+        bool backwardDone = backward.frontier.isEmpty() || backward.frontier.minPriority() >= bestCost;
+        if (forwardDone && backwardDone) break;
+        if (forwardDone) isForward = false;
+        if (backwardDone) isForward = true;
+
+        SearchContext& self = isForward ? forward : backward;
+        SearchContext& other = isForward ? backward : forward;
+        const int* first = isForward ? hierarchy.upFirst : hierarchy.downFirst;
+        const int* target = isForward ? hierarchy.upTarget : hierarchy.downSource;
+        const double* cost = isForward ? hierarchy.upCost : hierarchy.downCost;
+
+        int lastId = self.frontier.popMin();
+        double lastCost = self.gScore[lastId];
+        self.markSettled(lastId);
+        counts.heapPops++;
+        counts.nodesSettled++;
+
+        if (other.isReached(lastId) && lastCost + other.gScore[lastId] < bestCost) {
+            bestCost = lastCost + other.gScore[lastId];
+            meetingNode = lastId;
+        }
+
+        for (int e = first[lastId]; e < first[lastId+1]; ++e) {
+            int eachId = target[e];
+            double newCost = lastCost + cost[e];
+            counts.edgesRelaxed++;
+            if (self.isSettled(eachId) || newCost >= self.costTo(eachId)) continue;
+            self.markReached(eachId,lastId,newCost);
+            self.frontier.pushOrDecrease(eachId,newCost);
+            counts.heapPushes++;
+        }
+        recorder.frontierSize(forward.frontier.size() + backward.frontier.size());
+        isForward = !isForward;
+    }
+
+    if (meetingNode == kNoParent) return {};
+    recorder.startPhase();
+    if (pathCost != nullptr) *pathCost = bestCost;
 
-    //set node to yellow
-    start->setColor(Color::YELLOW);
-    myNodeColors[start] = "yellow";
+    //unpack start..meetingNode, then meetingNode..end along backward predecessors
+    vector<int> hierarchyPath = forward.pathTo(meetingNode);
+    vector<int> path = {start};
+    for (size_t i = 1; i < hierarchyPath.size(); ++i) {
+        unpackArc(hierarchy,hierarchyPath[i-1],hierarchyPath[i],path);
+    }
+    for (int curr = meetingNode; backward.parent[curr] != kNoParent; curr = backward.parent[curr]) {
+        unpackArc(hierarchy,curr,backward.parent[curr],path);
+    }
+    return path;
+}
 
-    //create first path and enqueue start node
-    Path firstPath;
-    firstPath += start;
-    myPaths.enqueue(firstPath,0.0);
 
-    while(!myPaths.isEmpty()) {
+/* Runs Dijkstra's algorithm from source over a hierarchy's up arcs (over down arcs,
+ * toward source, if backward is set) until the frontier is empty, and returns the nodes
+ * settled, in order. Only nodes ranked above source are ever reached, so the search stays
+ * small; context.gScore then holds the upward cost of each settled node.
+ */
+vector<int> growUpwardSearch(const ContractionHierarchy& hierarchy, SearchContext& context,
+                             int source, bool backward) {
+    const int* first = backward ? hierarchy.downFirst : hierarchy.upFirst;
+    const int* target = backward ? hierarchy.downSource : hierarchy.upTarget;
+    const double* cost = backward ? hierarchy.downCost : hierarchy.upCost;
+
+    SearchRecorder recorder(context);
+    SearchStats& counts = recorder.counts;
+    context.beginQuery(source);
+    context.frontier.clear();
+    context.markReached(source,kNoParent,0.0);
+    context.frontier.pushOrDecrease(source,0.0);
+    recorder.startPhase();
+
+    vector<int> settled;
+    while (!context.frontier.isEmpty()) {
+        int lastId = context.frontier.popMin();
+        double lastCost = context.gScore[lastId];
+        context.markSettled(lastId);
+        settled.push_back(lastId);
+        counts.heapPops++;
+        counts.nodesSettled++;
+
+        for (int e = first[lastId]; e < first[lastId+1]; ++e) {
+            int eachId = target[e];
+            double newCost = lastCost + cost[e];
+            counts.edgesRelaxed++;
+            if (context.isSettled(eachId) || newCost >= context.costTo(eachId)) continue;
+            context.markReached(eachId,lastId,newCost);
+            context.frontier.pushOrDecrease(eachId,newCost);
+            counts.heapPushes++;
+        }
+        recorder.frontierSize(context.frontier.size());
+    }
+    return settled;
+}
 
-        Path deqPath = myPaths.dequeue();
-        RoadNode* lastNode = deqPath[deqPath.size()-1];
 
-        if (lastNode == end) {
-            lastNode->setColor(Color::GREEN);
-            return deqPath;
+/* Appends the original nodes along hierarchy arc from->to (excluding from) to path,
+ * recursively replacing each shortcut by the two arcs around the node it bypasses.
+ */
+void unpackArc(const ContractionHierarchy& hierarchy, int from, int to, vector<int>& path) {
+    vector<pair<int,int>> pending = {{from,to}};
+    while (!pending.empty()) {
+        pair<int,int> arc = pending.back();
+        pending.pop_back();
+        int middle = hierarchy.middleOf(arc.first,arc.second);
+        if (middle == kNoParent) {
+            path.push_back(arc.second);
+        } else {
+            pending.push_back({middle,arc.second});
+            pending.push_back({arc.first,middle});
         }
+    }
+}
 
-        if (myNodeColors.get(lastNode) != "green") {
 
-            //set node to green
-            lastNode->setColor(Color::GREEN);
-            myNodeColors[lastNode] = "green";
+//node bypassed by hierarchy arc from->to, kNoParent if the arc is an original edge
+int ContractionHierarchy::middleOf(int from, int to) const {
+    if (rank[from] < rank[to]) {
+        for (int e = upFirst[from]; e < upFirst[from+1]; ++e) {
+            if (upTarget[e] == to) return upMiddle[e];
+        }
+    } else {
+        for (int e = downFirst[to]; e < downFirst[to+1]; ++e) {
+            if (downSource[e] == from) return downMiddle[e];
+        }
+    }
+    return kNoParent;
+}
+
 
-            //get node's neighbors and loop through them
-            auto neighbors = graph.neighborsOf(lastNode);
+/* Points the arrays into an image laid out as described in buildContractionHierarchy.
+ * Returns false if the image is too short for the counts in its header.
+ */
+bool ContractionHierarchy::attach(const char* image, size_t imageSize) {
+    if (imageSize < 24 || memcmp(image,"CH01",4) != 0) return false;
+    int32_t counts[3];
+    memcpy(counts,image+4,sizeof(counts));
+    if (counts[0] < 0 || counts[1] < 0 || counts[2] < 0) return false;
+    size_t needed = 24 + sizeof(double)*(size_t(counts[1]) + counts[2])
+                  + sizeof(int32_t)*(size_t(counts[0]) + 2*(size_t(counts[0])+1)
+                                     + 2*size_t(counts[1]) + 2*size_t(counts[2]));
+    if (imageSize < needed) return false;
+
+    numNodes = counts[0];
+    numUpArcs = counts[1];
+    numDownArcs = counts[2];
+    memcpy(&graphFingerprint,image+16,sizeof(graphFingerprint));
+    upCost = reinterpret_cast<const double*>(image+24);
+    downCost = upCost + numUpArcs;
+    rank = reinterpret_cast<const int32_t*>(downCost + numDownArcs);
+    upFirst = rank + numNodes;
+    upTarget = upFirst + numNodes + 1;
+    upMiddle = upTarget + numUpArcs;
+    downFirst = upMiddle + numUpArcs;
+    downSource = downFirst + numNodes + 1;
+    downMiddle = downSource + numDownArcs;
+    return true;
+}
 
-            for (RoadNode* eachNode : neighbors) {
 
-                //only if they are not green
-                if (myNodeColors.get(eachNode) != "green") {
+//writes the hierarchy's image to a file, returning false if it could not be written
+bool ContractionHierarchy::save(const string& fileName) const {
+    if (rank == nullptr) return false;
+    const char* image = reinterpret_cast<const char*>(upCost) - 24;
+    size_t imageSize = reinterpret_cast<const char*>(downMiddle + numDownArcs) - image;
+    ofstream out(fileName,ios::binary);
+    out.write(image,imageSize);
+    return bool(out);
+}
 
-                    //color neighbors yellow
-                    eachNode->setColor(Color::YELLOW);
-                    myNodeColors[eachNode] = "yellow";
 
-                    //enqueue path using distance as priority
-                    Path copyPath = deqPath;
-                    copyPath+=eachNode;                    
-                    myPaths.enqueue(copyPath,nodeCost(graph,copyPath));
-                }
-            }
-        }
+/* Memory-maps a file written by save (reads it into memory where mmap is unavailable).
+ * Returns false if the file is missing or damaged or was built for a different graph
+ * than snapshot, leaving the hierarchy untouched.
+ */
+bool ContractionHierarchy::load(const RoadGraphSnapshot& snapshot, const string& fileName) {
+    ContractionHierarchy loaded;
+#ifndef _WIN32
+    int fd = open(fileName.c_str(),O_RDONLY);
+    if (fd < 0) return false;
+    struct stat info;
+    if (fstat(fd,&info) != 0 || info.st_size == 0) {
+        close(fd);
+        return false;
     }
-    return {};
+    void* mapped = mmap(nullptr,info.st_size,PROT_READ,MAP_SHARED,fd,0);
+    close(fd);
+    if (mapped == MAP_FAILED) return false;
+    loaded.mappedImage = mapped;
+    loaded.mappedSize = info.st_size;
+    if (!loaded.attach(static_cast<const char*>(mapped),info.st_size)) return false;
+#else
+    ifstream in(fileName,ios::binary | ios::ate);
+    if (!in) return false;
+    size_t imageSize = in.tellg();
+    in.seekg(0);
+    loaded.ownedImage.resize((imageSize + 7)/8);
+    in.read(reinterpret_cast<char*>(loaded.ownedImage.data()),imageSize);
+    if (!in || !loaded.attach(reinterpret_cast<const char*>(loaded.ownedImage.data()),imageSize)) {
+        return false;
+    }
+#endif
+    if (loaded.numNodes != snapshot.numNodes()
+            || loaded.graphFingerprint != fingerprintOf(snapshot)) {
+        return false;
+    }
+    *this = move(loaded);
+    return true;
 }
 
 
-/* This function uses the A* Search algorithm to find shortest path
- * from start node to end node. This algorithm takes edge cost and map knowedledge
- * into account, and is therefore, faster than two previous algorithms
+ContractionHierarchy::ContractionHierarchy(ContractionHierarchy&& other) {
+    *this = move(other);
+}
+
+
+//takes over other's image; the array pointers stay valid because the image itself moves
+ContractionHierarchy& ContractionHierarchy::operator=(ContractionHierarchy&& other) {
+    if (this == &other) return *this;
+#ifndef _WIN32
+    if (mappedImage != nullptr) munmap(mappedImage,mappedSize);
+#endif
+    numNodes = other.numNodes;
+    numUpArcs = other.numUpArcs;
+    numDownArcs = other.numDownArcs;
+    graphFingerprint = other.graphFingerprint;
+    rank = other.rank;
+    upFirst = other.upFirst;
+    upTarget = other.upTarget;
+    upMiddle = other.upMiddle;
+    upCost = other.upCost;
+    downFirst = other.downFirst;
+    downSource = other.downSource;
+    downMiddle = other.downMiddle;
+    downCost = other.downCost;
+    ownedImage = move(other.ownedImage);
+    mappedImage = other.mappedImage;
+    mappedSize = other.mappedSize;
+    other.mappedImage = nullptr;
+    other.mappedSize = 0;
+    other.rank = nullptr;
+    return *this;
+}
+
+
+ContractionHierarchy::~ContractionHierarchy() {
+#ifndef _WIN32
+    if (mappedImage != nullptr) munmap(mappedImage,mappedSize);
+#endif
+}
+
+
+/* Converts a RoadGraph into a RoadGraphSnapshot: nodes are numbered in order of their
+ * names, so the same map gets the same IDs in every run (preprocessed data saved to disk
+ * refers to nodes by ID), and each node's outgoing edges are laid out contiguously.
  */
-Path aStar(const RoadGraph& graph, RoadNode* start, RoadNode* end) {
+RoadGraphSnapshot buildSnapshot(const RoadGraph& graph) {
+    RoadGraphSnapshot snapshot;
+    snapshot.graph = &graph;
+    snapshot.maxRoadSpeed = graph.maxRoadSpeed();
 
-    //edge case
-    if (start==end){
-        return {start};
+    for (RoadNode* eachNode : graph.allNodes()) {
+        snapshot.nodes.push_back(eachNode);
+    }
+    stable_sort(snapshot.nodes.begin(),snapshot.nodes.end(),[](RoadNode* a, RoadNode* b) {
+        return a->nodeName() < b->nodeName();
+    });
+    for (size_t i = 0; i < snapshot.nodes.size(); ++i) {
+        snapshot.nodeIds[snapshot.nodes[i]] = i;
     }
 
-    //use pqueue
-    PriorityQueue<Path> myPaths;
-    Map<RoadNode*,string> myNodeColors;
-
-    //set node to yellow
-    start->setColor(Color::YELLOW);
-    myNodeColors[start] = "yellow";
+    snapshot.firstEdge.reserve(snapshot.nodes.size()+1);
+    for (RoadNode* eachNode : snapshot.nodes) {
+        snapshot.firstEdge.push_back(snapshot.edgeTarget.size());
+        for (RoadEdge* eachEdge : eachNode->outgoingEdges()) {
+            snapshot.edgeTarget.push_back(snapshot.nodeIds[eachEdge->to()]);
+            snapshot.edgeCost.push_back(eachEdge->cost());
+        }
+    }
+    snapshot.firstEdge.push_back(snapshot.edgeTarget.size());
+    buildReverseEdges(snapshot);
+    return snapshot;
+}
 
-    //create first path and enqueue start node
-    Path firstPath;
-    firstPath += start;
-    myPaths.enqueue(firstPath,0.0);
 
-    while(!myPaths.isEmpty()) {
+/* Builds a snapshot from an edge list over nodes 0..x.size()-1 placed at (x[v],y[v]).
+ * Edges keep their order within each source node. The top speed is set to the largest
+ * crow-fly distance per unit of cost over all edges, so the A* heuristic never
+ * overestimates (with all coordinates equal it is simply 0).
+ */
+RoadGraphSnapshot buildSnapshot(const vector<double>& x, const vector<double>& y,
+                                const vector<SnapshotEdge>& edges) {
+    RoadGraphSnapshot snapshot;
+    int numNodes = x.size();
+    snapshot.nodes.assign(numNodes,nullptr);
+    snapshot.nodeX = x;
+    snapshot.nodeY = y;
+
+    snapshot.firstEdge.assign(numNodes+1,0);
+    for (const SnapshotEdge& edge : edges) {
+        snapshot.firstEdge[edge.from+1]++;
+    }
+    for (int v = 0; v < numNodes; ++v) {
+        snapshot.firstEdge[v+1] += snapshot.firstEdge[v];
+    }
+    snapshot.edgeTarget.resize(edges.size());
+    snapshot.edgeCost.resize(edges.size());
+    vector<int> nextSlot(snapshot.firstEdge.begin(),snapshot.firstEdge.end()-1);
+    double maxSpeed = 0.0;
+    for (const SnapshotEdge& edge : edges) {
+        int slot = nextSlot[edge.from]++;
+        snapshot.edgeTarget[slot] = edge.to;
+        snapshot.edgeCost[slot] = edge.cost;
+        double length = hypot(x[edge.from] - x[edge.to],y[edge.from] - y[edge.to]);
+        if (length > 0.0) maxSpeed = max(maxSpeed,edge.cost > 0.0 ? length/edge.cost : DBL_MAX);
+    }
+    snapshot.maxRoadSpeed = maxSpeed > 0.0 ? maxSpeed : 1.0;
+    buildReverseEdges(snapshot);
+    return snapshot;
+}
 
-        Path deqPath = myPaths.dequeue();
-        RoadNode* lastNode = deqPath[deqPath.size()-1];
 
-        if (lastNode == end) {
-            lastNode->setColor(Color::GREEN);
-            return deqPath;
+//groups a snapshot's edges by target node (counting sort) for backward searches
+void buildReverseEdges(RoadGraphSnapshot& snapshot) {
+    int numNodes = snapshot.numNodes();
+    int numEdges = snapshot.edgeTarget.size();
+    snapshot.firstInEdge.assign(numNodes+1,0);
+    for (int target : snapshot.edgeTarget) {
+        snapshot.firstInEdge[target+1]++;
+    }
+    for (int v = 0; v < numNodes; ++v) {
+        snapshot.firstInEdge[v+1] += snapshot.firstInEdge[v];
+    }
+    snapshot.inEdgeSource.resize(numEdges);
+    snapshot.inEdgeCost.resize(numEdges);
+    vector<int> nextSlot(snapshot.firstInEdge.begin(),snapshot.firstInEdge.end()-1);
+    for (int v = 0; v < numNodes; ++v) {
+        for (int e = snapshot.firstEdge[v]; e < snapshot.firstEdge[v+1]; ++e) {
+            int slot = nextSlot[snapshot.edgeTarget[e]]++;
+            snapshot.inEdgeSource[slot] = v;
+            snapshot.inEdgeCost[slot] = snapshot.edgeCost[e];
         }
+    }
+}
+
+
+/* The incoming edge array's copy of out-edge e of from. buildReverseEdges fills each
+ * node's incoming edges by source and then in out-edge order, so parallel edges between
+ * the same two nodes keep their order: the k-th edge from from to the target is the k-th
+ * incoming edge of the target whose source is from.
+ */
+int reverseEdgeOf(const RoadGraphSnapshot& snapshot, int from, int e) {
+    int to = snapshot.edgeTarget[e];
+    int k = 0;
+    for (int out = snapshot.firstEdge[from]; out < e; ++out) {
+        if (snapshot.edgeTarget[out] == to) k++;
+    }
+    for (int in = snapshot.firstInEdge[to]; in < snapshot.firstInEdge[to+1]; ++in) {
+        if (snapshot.inEdgeSource[in] == from && k-- == 0) return in;
+    }
+    error("reverseEdgeOf: the snapshot's incoming edges don't match its outgoing ones");
+    return kNoEdge;
+}
 
-        if (myNodeColors.get(lastNode) != "green") {
 
-            //set node to green
-            lastNode->setColor(Color::GREEN);
-            myNodeColors[lastNode] = "green";
+//the one SnapshotCache shared by every RoadGraph entry point
+SnapshotCache& snapshotCache() {
+    static SnapshotCache cache;
+    return cache;
+}
 
-            //get node's neighbors and loop through them
-            auto neighbors = graph.neighborsOf(lastNode);
 
-            for (RoadNode* eachNode : neighbors) {
+/* Returns the snapshot of a RoadGraph, building it the first time the graph is searched.
+ * The snapshot is a copy: after changing a graph's nodes, edges or costs, or before
+ * destroying it (another graph may later be created at the same address), call
+ * forgetSnapshot so that the next query takes a new one.
+ */
+shared_ptr<const RoadGraphSnapshot> snapshotOf(const RoadGraph& graph) {
+    SnapshotCache& cache = snapshotCache();
+    {
+        lock_guard<mutex> guard(cache.lock);
+        if (cache.snapshots.containsKey(&graph)) return cache.snapshots.get(&graph);
+    }
 
-                //only if they are not green
-                if (myNodeColors.get(eachNode) != "green") {
+    //build outside the lock; if another thread got there first, its snapshot wins
+    shared_ptr<const RoadGraphSnapshot> built = make_shared<RoadGraphSnapshot>(buildSnapshot(graph));
+    lock_guard<mutex> guard(cache.lock);
+    if (!cache.snapshots.containsKey(&graph)) cache.snapshots.put(&graph,built);
+    return cache.snapshots.get(&graph);
+}
 
-                    //color neighbors yellow
-                    eachNode->setColor(Color::YELLOW);
-                    myNodeColors[eachNode] = "yellow";
 
-                    //enqueue path using distance PLUS HEURISTIC as priority
-                    Path copyPath = deqPath;
-                    copyPath+=eachNode;
-                    myPaths.enqueue(copyPath,
-                                    nodeCost(graph,copyPath) +
-                                    nodeHeuristic(graph,eachNode,end));
-                }
-            }
-        }
+//drops the cached snapshot of a graph (see snapshotOf)
+void forgetSnapshot(const RoadGraph& graph) {
+    SnapshotCache& cache = snapshotCache();
+    lock_guard<mutex> guard(cache.lock);
+    cache.snapshots.remove(&graph);
+}
+
+
+/* Takes the graph's snapshot and this thread's contexts over it. Concurrent queries on
+ * one graph share nothing but the read-only snapshot, though they do color the same
+ * RoadNodes; callers that search from several threads at once usually want their own
+ * uncolored SearchContexts (or a RouteQueryExecutor) instead.
+ */
+ColoringQuery::ColoringQuery(const RoadGraph& graph, bool colorsNodes)
+    : snapshot(snapshotOf(graph)),
+      observer(*snapshot),
+      contexts(queryContextsFor(snapshot,ownContexts)),
+      forward(*contexts.forward),
+      backward(*contexts.backward) {
+    contexts.isInUse = true;
+    for (SearchContext* context : {&forward,&backward}) {
+        context->observer = colorsNodes ? &observer : nullptr;
+        context->landmarks = nullptr;
+        context->searchesBackward = false;
+        attachRecording(graph,*context);
     }
-    return {};
+}
+
+//hands the contexts back to the thread, pointing at nothing that dies with the query
+ColoringQuery::~ColoringQuery() {
+    for (SearchContext* context : {&forward,&backward}) {
+        context->observer = nullptr;
+        context->landmarks = nullptr;
+        context->stats = nullptr;
+        context->histogram = nullptr;
+    }
+    contexts.isInUse = false;
 }
 
 
-/* This function uses the A* Search algorithm to find shortest/main path (described above).
- * To identify an alternate route, this function loops through each edge of the
- * main path and calls a revised form of the A* Search algorithm (named alternativeRouteEdge;
- * described below) that will exclude each of these edges. Out of these alternative paths,
- * only those that are at least 20% unique from the main path will be considered. Out of
- * these paths, the shortest is returned.
+/* The calling thread's QueryContexts, rebuilt first if they were made for another
+ * snapshot. If they are in use by a query further up the stack, a fresh pair is made in
+ * ownContexts and returned instead.
  */
-Path alternativeRoute(const RoadGraph& graph, RoadNode* start, RoadNode* end) {
+QueryContexts& queryContextsFor(const shared_ptr<const RoadGraphSnapshot>& snapshot,
+                                unique_ptr<QueryContexts>& ownContexts) {
+    thread_local QueryContexts cached;
+    QueryContexts* contexts = &cached;
+    if (cached.isInUse) {
+        ownContexts.reset(new QueryContexts);
+        contexts = ownContexts.get();
+    }
+    if (contexts->forward == nullptr || contexts->snapshot.lock() != snapshot) {
+        contexts->snapshot = snapshot;
+        contexts->forward.reset(new SearchContext(*snapshot));
+        contexts->backward.reset(new SearchContext(*snapshot));
+    }
+    return *contexts;
+}
 
-    //find best path (using A*)
-    Path mainPath = aStar(graph,start,end);
 
-    //get main path's edges
-    Vector<RoadEdge*> myEdges = getEdges(graph,mainPath);
+//points context's stats and histogram wherever recordSearchStats asked graph's searches to go
+void attachRecording(const RoadGraph& graph, SearchContext& context) {
+    SnapshotCache& cache = snapshotCache();
+    lock_guard<mutex> guard(cache.lock);
+    context.stats = cache.stats.get(&graph);
+    context.histogram = cache.histograms.get(&graph);
+}
 
-    //to save alternative paths (that are at least 20% unique)
-    Vector<Path> altPaths;
 
-    //loop through edges, excluding each of them
-    for (RoadEdge* eachEdge : myEdges) {
-        Path newAltPath = alternativeRouteEdge(graph,start,end,eachEdge);
-        if (isTwentyUnique(mainPath,newAltPath)) {
-            altPaths+=newAltPath;
-        }
+//returns the snapshot ID of a node; it is an error to ask for a node of another graph
+int RoadGraphSnapshot::idOf(RoadNode* node) const {
+    if (!nodeIds.containsKey(node)) {
+        error("RoadGraphSnapshot::idOf: the node is not in this snapshot's graph");
     }
+    return nodeIds.get(node);
+}
+
 
-    //if no alternative paths fit criteria (20% unique or more)
-    if (altPaths.isEmpty()) return {};
+//returns the index of the edge from one node to another, kNoEdge if there is none
+int RoadGraphSnapshot::edgeBetween(int from, int to) const {
+    for (int e = firstEdge[from]; e < firstEdge[from+1]; ++e) {
+        if (edgeTarget[e] == to) return e;
+    }
+    return kNoEdge;
+}
 
-    //else, find the shortest path among alternative paths
-    double mySentinel = DBL_MAX;
-    Path shortestAltPath;
 
-    for (Path eachPath : altPaths) {
-        if (nodeCost(graph,eachPath) < mySentinel) {
-            shortestAltPath = eachPath;
-            mySentinel = nodeCost(graph,eachPath);
-        }
+//calculate Heuristic for A* Search algorithm
+double RoadGraphSnapshot::heuristic(int from, int to) const {
+    if (graph == nullptr) {
+        return hypot(nodeX[from] - nodeX[to],nodeY[from] - nodeY[to])/maxRoadSpeed;
     }
-    return shortestAltPath;
+    return graph->crowFlyDistanceBetween(nodes[from],nodes[to])/maxRoadSpeed;
 }
 
 
-/* helper function for alternativeRoute function (see above). It uses the structure
- * of A* Search, but will exclude a specific edge (appropriately named "edgeToExclude")
+SearchContext::SearchContext(const RoadGraphSnapshot& snapshot, SearchObserver* observer)
+    : snapshot(snapshot),
+      observer(observer) {
+}
+
+
+/* Starts a new query toward endNode. Only bumps the generation, except when the snapshot
+ * has changed size (arrays are reallocated) or the counter wraps around (stamps are
+ * cleared so no stale stamp can match the new generation).
  */
-Path alternativeRouteEdge(const RoadGraph& graph, RoadNode* start, RoadNode* end,
-                          RoadEdge* edgeToExclude) {
+void SearchContext::beginQuery(int endNode) {
+    endId = endNode;
+    int numNodes = snapshot.numNodes();
+    if (int(reachedStamp.size()) != numNodes) {
+        reachedStamp.assign(numNodes,0);
+        settledStamp.assign(numNodes,0);
+        heuristicStamp.assign(numNodes,0);
+        parent.assign(numNodes,kNoParent);
+        gScore.assign(numNodes,DBL_MAX);
+        hScore.assign(numNodes,0.0);
+        generation = 0;
+    }
+    generation++;
+    if (generation == 0) {
+        fill(reachedStamp.begin(),reachedStamp.end(),0);
+        fill(settledStamp.begin(),settledStamp.end(),0);
+        fill(heuristicStamp.begin(),heuristicStamp.end(),0);
+        generation = 1;
+    }
+}
 
-    //edge case
-    if (start==end){
-        return {start};
+
+/* Returns a fresh stamp for markStamp: no node carries it until the caller sets
+ * markStamp[id] to it, so a set of nodes can be flagged without clearing anything.
+ */
+uint32_t SearchContext::newMark() {
+    if (int(markStamp.size()) != snapshot.numNodes()) {
+        markStamp.assign(snapshot.numNodes(),0);
+        markGeneration = 0;
+    }
+    markGeneration++;
+    if (markGeneration == 0) {
+        fill(markStamp.begin(),markStamp.end(),0);
+        markGeneration = 1;
     }
+    return markGeneration;
+}
 
-    //use pqueue
-    PriorityQueue<Path> myPaths;
-    Map<RoadNode*,string> myNodeColors;
 
-    //set node to yellow
-    start->setColor(Color::YELLOW);
-    myNodeColors[start] = "yellow";
+//records a (cheaper) way of reaching a node
+void SearchContext::markReached(int id, int parentId, double cost) {
+    reachedStamp[id] = generation;
+    parent[id] = parentId;
+    gScore[id] = cost;
+    if (observer != nullptr) observer->nodeReached(id);
+}
 
-    //create first path and enqueue start node
-    Path firstPath;
-    firstPath += start;
-    myPaths.enqueue(firstPath,0.0);
 
-    while(!myPaths.isEmpty()) {
+//records that a node's cost from the start node is final
+void SearchContext::markSettled(int id) {
+    settledStamp[id] = generation;
+    if (observer != nullptr) observer->nodeSettled(id);
+}
 
-        Path deqPath = myPaths.dequeue();
-        RoadNode* lastNode = deqPath[deqPath.size()-1];
 
-        if (lastNode == end) {
-            lastNode->setColor(Color::GREEN);
-            return deqPath;
+/* Heuristic from a node to the end node (from the end node to the node when searching
+ * backward), computed the first time it is asked for
+ */
+double SearchContext::heuristic(int id) {
+    if (heuristicStamp[id] != generation) {
+        heuristicStamp[id] = generation;
+        int from = searchesBackward ? endId : id;
+        int to = searchesBackward ? id : endId;
+        double estimate = snapshot.heuristic(from,to);
+        if (landmarks != nullptr) {
+            estimate = max(estimate,landmarks->lowerBound(from,to));
         }
+        hScore[id] = estimate;
+    }
+    return hScore[id];
+}
 
-        if (myNodeColors.get(lastNode) != "green") {
 
-            //set node to green
-            lastNode->setColor(Color::GREEN);
-            myNodeColors[lastNode] = "green";
+TravelTimeProfiles::TravelTimeProfiles(const RoadGraphSnapshot& snapshot)
+    : snapshot(snapshot),
+      pointsOf(snapshot.edgeTarget.size()) {
+}
 
-            //get node's neighbors and loop through them
-            auto neighbors = graph.neighborsOf(lastNode);
+/* Gives the edge from one node to another a travel-time profile, replacing any earlier
+ * one (an empty list of points restores the static cost). Returns false, changing
+ * nothing, if there is no such edge or the points are not a valid FIFO profile:
+ * departures must increase, travel times must not be negative, and between two points
+ * the travel time may not drop faster than time passes.
+ */
+bool TravelTimeProfiles::setProfile(int from, int to, const vector<ProfilePoint>& points) {
+    int e = snapshot.edgeBetween(from,to);
+    if (e == kNoEdge) return false;
+    for (size_t i = 0; i < points.size(); ++i) {
+        if (points[i].travelTime < 0.0) return false;
+        if (i == 0) continue;
+        double elapsed = points[i].departure - points[i-1].departure;
+        if (elapsed <= 0.0 || points[i].travelTime - points[i-1].travelTime < -elapsed) {
+            return false;
+        }
+    }
 
-            for (RoadNode* eachNode : neighbors) {
+    pointsOf[e] = points;
+    for (const ProfilePoint& point : points) {
+        if (snapshot.edgeCost[e] > 0.0) {
+            heuristicScale = min(heuristicScale,point.travelTime/snapshot.edgeCost[e]);
+        }
+    }
+    return true;
+}
 
-                RoadEdge* currEdge = graph.edgeBetween(lastNode,eachNode);
+//travel time along a snapshot edge when entering it at the given time
+double TravelTimeProfiles::travelTime(int edge, double departure) const {
+    const vector<ProfilePoint>& points = pointsOf[edge];
+    if (points.empty()) return snapshot.edgeCost[edge];
+    if (departure <= points.front().departure) return points.front().travelTime;
+    if (departure >= points.back().departure) return points.back().travelTime;
+
+    //interpolate between the breakpoints on either side of departure
+    size_t next = upper_bound(points.begin(),points.end(),departure,
+                              [](double time, const ProfilePoint& point) {
+                                  return time < point.departure;
+                              }) - points.begin();
+    const ProfilePoint& before = points[next-1];
+    const ProfilePoint& after = points[next];
+    double fraction = (departure - before.departure)/(after.departure - before.departure);
+    return before.travelTime + fraction*(after.travelTime - before.travelTime);
+}
 
-                //only if they are not green
-                if (myNodeColors.get(eachNode) != "green"
-                        && currEdge->cost() != edgeToExclude->cost()) {
 
-                    //color neighbors yellow
-                    eachNode->setColor(Color::YELLOW);
-                    myNodeColors[eachNode] = "yellow";
+//grows the full tree out of sourceId with Dijkstra's algorithm and keeps a copy of it
+void ShortestPathTree::grow(SearchContext& context, int sourceId) {
+    growShortestPathTree(context,sourceId,false);
+    int numNodes = context.snapshot.numNodes();
+    source = sourceId;
+    cost.resize(numNodes);
+    parent.resize(numNodes);
+    for (int v = 0; v < numNodes; ++v) {
+        cost[v] = context.costTo(v);
+        parent[v] = context.isReached(v) ? context.parent[v] : kNoParent;
+    }
+}
 
-                    //enqueue path using distance + heuristic as priority
-                    Path copyPath = deqPath;
-                    copyPath+=eachNode;
-                    myPaths.enqueue(copyPath,
-                                    nodeCost(graph,copyPath) +
-                                    nodeHeuristic(graph,eachNode,end));
-                }
+/* Brings the tree up to date after updateEdgeCosts, touching only the part of the tree
+ * the changes can affect. Every node below a tree edge that got more expensive loses its
+ * cost and is offered the cheapest way in from a node outside that subtree; every edge
+ * that got cheaper offers its target a new cost. A Dijkstra pass then propagates the
+ * improvements from those nodes onward, relaxing only out of nodes whose cost changed.
+ */
+void ShortestPathTree::repair(const RoadGraphSnapshot& snapshot,
+                              const vector<EdgeCostChange>& changes) {
+
+    //find the subtrees hanging below more expensive tree edges; a node's children are
+    //among its out-neighbors, so the walk never looks beyond the subtree's own edges
+    if (lostStamp.size() != cost.size()) {
+        lostStamp.assign(cost.size(),0);
+        lostGeneration = 0;
+    }
+    lostGeneration++;
+    if (lostGeneration == 0) {
+        fill(lostStamp.begin(),lostStamp.end(),0);
+        lostGeneration = 1;
+    }
+    auto isLost = [&](int id) {
+        return lostStamp[id] == lostGeneration;
+    };
+    lostNodes.clear();
+    for (const EdgeCostChange& change : changes) {
+        if (change.newCost <= change.oldCost) continue;
+        if (parent[change.to] != change.from || isLost(change.to)) continue;
+        lostStamp[change.to] = lostGeneration;
+        lostNodes.push_back(change.to);
+    }
+    for (size_t i = 0; i < lostNodes.size(); ++i) {
+        int lastId = lostNodes[i];
+        for (int e = snapshot.firstEdge[lastId]; e < snapshot.firstEdge[lastId+1]; ++e) {
+            int eachId = snapshot.edgeTarget[e];
+            if (!isLost(eachId) && parent[eachId] == lastId) {
+                lostStamp[eachId] = lostGeneration;
+                lostNodes.push_back(eachId);
             }
         }
     }
-    return {};
+    for (int id : lostNodes) {
+        cost[id] = DBL_MAX;
+        parent[id] = kNoParent;
+    }
+
+    //offer lost nodes their cheapest way back in, and cheaper edges their targets
+    frontier.clear();
+    auto offer = [&](int from, int to, double edgeCost) {
+        if (cost[from] == DBL_MAX || cost[from] + edgeCost >= cost[to]) return;
+        cost[to] = cost[from] + edgeCost;
+        parent[to] = from;
+        frontier.pushOrDecrease(to,cost[to]);
+    };
+    for (int id : lostNodes) {
+        for (int in = snapshot.firstInEdge[id]; in < snapshot.firstInEdge[id+1]; ++in) {
+            offer(snapshot.inEdgeSource[in],id,snapshot.inEdgeCost[in]);
+        }
+    }
+    for (const EdgeCostChange& change : changes) {
+        if (change.newCost < change.oldCost) {
+            offer(change.from,change.to,snapshot.edgeCost[change.edge]);
+        }
+    }
+
+    while (!frontier.isEmpty()) {
+        int lastId = frontier.popMin();
+        for (int e = snapshot.firstEdge[lastId]; e < snapshot.firstEdge[lastId+1]; ++e) {
+            offer(lastId,snapshot.edgeTarget[e],snapshot.edgeCost[e]);
+        }
+    }
+}
+
+//IDs along the tree path from the source to a node, empty if the node is unreachable
+vector<int> ShortestPathTree::pathTo(int id) const {
+    if (cost[id] == DBL_MAX) return {};
+    vector<int> path;
+    for (int curr = id; curr != kNoParent; curr = parent[curr]) {
+        path.push_back(curr);
+    }
+    reverse(path.begin(),path.end());
+    return path;
 }
 
 
-//get cost of new node for Dijkstra's algorithm
-double nodeCost(const RoadGraph& graph, const Path& path) {
-    Path deqPath = path;
-    RoadNode* firstNode = deqPath[0];
-    deqPath.remove(0);
-    double dist = 0.0;
-    for (RoadNode* eachNode : deqPath) {
-        RoadEdge* myEdge = graph.edgeBetween(firstNode,eachNode);
-        dist += myEdge->cost();
-        firstNode = eachNode;
+//walks predecessors back from a node to the start node and returns the IDs in travel order
+vector<int> SearchContext::pathTo(int id) const {
+    int hops = 0;
+    for (int curr = id; curr != kNoParent; curr = parent[curr]) {
+        hops++;
     }
-    return dist;
+    vector<int> path(hops);
+    for (int curr = id; curr != kNoParent; curr = parent[curr]) {
+        path[--hops] = curr;
+    }
+    return path;
+}
+
+//total bytes reserved by the context's arrays and frontier
+size_t SearchContext::bufferBytes() const {
+    size_t numStamps = reachedStamp.capacity() + settledStamp.capacity()
+                       + heuristicStamp.capacity() + markStamp.capacity();
+    return numStamps*sizeof(uint32_t) + parent.capacity()*sizeof(int)
+           + (gScore.capacity() + hScore.capacity())*sizeof(double)
+           + frontier.capacityBytes();
 }
 
 
-//calculate Heuristic for A* Search algorithm
-double nodeHeuristic(const RoadGraph& graph, RoadNode* current, RoadNode* end) {
-    return graph.crowFlyDistanceBetween(current,end)/graph.maxRoadSpeed();
+SearchRecorder::SearchRecorder(SearchContext& context, SearchContext* other)
+    : context(context),
+      other(other),
+      isTimed(context.stats != nullptr || context.histogram != nullptr),
+      bytesBefore(bufferBytes()) {
+    counts.numSearches = 1;
+    if (isTimed) phaseStart = chrono::steady_clock::now();
 }
 
+size_t SearchRecorder::bufferBytes() const {
+    return context.bufferBytes() + (other != nullptr ? other->bufferBytes() : 0);
+}
 
-//gets all edges within a path
-Vector<RoadEdge*> getEdges(const RoadGraph& graph, const Path& path) {
+//ends the current phase (setup, then search) and starts the next one
+void SearchRecorder::startPhase() {
+    if (!isTimed) return;
+    chrono::steady_clock::time_point now = chrono::steady_clock::now();
+    double seconds = chrono::duration<double>(now - phaseStart).count();
+    if (phase == 0) {
+        counts.setupSeconds += seconds;
+    } else {
+        counts.searchSeconds += seconds;
+    }
+    phase++;
+    phaseStart = now;
+}
 
-    Vector<RoadEdge*> myEdges;
+//ends the last phase and charges everything counted to the context
+SearchRecorder::~SearchRecorder() {
+    if (!isTimed) return;
+    double seconds = chrono::duration<double>(chrono::steady_clock::now() - phaseStart).count();
+    if (phase == 0) {
+        counts.setupSeconds += seconds;
+    } else if (phase == 1) {
+        counts.searchSeconds += seconds;
+    } else {
+        counts.pathSeconds += seconds;
+    }
+    counts.bytesAllocated += bufferBytes() - bytesBefore;
+    if (context.stats != nullptr) *context.stats += counts;
+    if (context.histogram != nullptr) context.histogram->add(counts);
+}
 
-    Path copyPath = path;
-    RoadNode* firstNode = copyPath[0];
-    copyPath.remove(0);
 
-    for (RoadNode* eachNode : copyPath) {
-        RoadEdge* mySingleEdge = graph.edgeBetween(firstNode,eachNode);
-        myEdges+=mySingleEdge;
-        firstNode = eachNode;
+QueryRecorder::QueryRecorder(SearchContext& forward, SearchContext& backward)
+    : forward(forward),
+      backward(backward),
+      stats(forward.stats),
+      histogram(forward.histogram),
+      backwardStats(backward.stats),
+      backwardHistogram(backward.histogram) {
+    if (stats == nullptr && histogram == nullptr) return;
+    for (SearchContext* context : {&forward,&backward}) {
+        context->stats = &counts;
+        context->histogram = nullptr;
     }
-    return myEdges;
+}
+
+//puts the contexts' own stats and histogram back and charges the query to them
+QueryRecorder::~QueryRecorder() {
+    if (stats == nullptr && histogram == nullptr) return;
+    forward.stats = stats;
+    forward.histogram = histogram;
+    backward.stats = backwardStats;
+    backward.histogram = backwardHistogram;
+    counts.numSearches = 1;
+    if (stats != nullptr) *stats += counts;
+    if (histogram != nullptr) histogram->add(counts);
 }
 
 
-/* determines whether alternative path is at least 20% unique
- * converts Path (Vector of nodes) into a Set of Nodes
- * to make the identification of unique nodes easier
- */
-bool isTwentyUnique(Path mainPath, Path altPath) {
+SearchStats& SearchStats::operator+=(const SearchStats& other) {
+    numSearches += other.numSearches;
+    nodesSettled += other.nodesSettled;
+    edgesRelaxed += other.edgesRelaxed;
+    heapPushes += other.heapPushes;
+    heapPops += other.heapPops;
+    peakFrontier = max(peakFrontier,other.peakFrontier);
+    bytesAllocated += other.bytesAllocated;
+    setupSeconds += other.setupSeconds;
+    searchSeconds += other.searchSeconds;
+    pathSeconds += other.pathSeconds;
+    return *this;
+}
+
+
+//adds one search (or the sums over several, counted as one) to every histogram
+void SearchStatsHistogram::add(const SearchStats& search) {
+    long long values[NUM_STATS_COUNTERS];
+    values[NODES_SETTLED] = search.nodesSettled;
+    values[EDGES_RELAXED] = search.edgesRelaxed;
+    values[HEAP_PUSHES] = search.heapPushes;
+    values[HEAP_POPS] = search.heapPops;
+    values[PEAK_FRONTIER] = search.peakFrontier;
+    values[BYTES_ALLOCATED] = search.bytesAllocated;
+    values[MICROSECONDS] = llround((search.setupSeconds + search.searchSeconds
+                                    + search.pathSeconds)*1e6);
+
+    for (int counter = 0; counter < NUM_STATS_COUNTERS; ++counter) {
+        int bucket = 0;
+        for (unsigned long long value = max(values[counter],0LL); value != 0; value >>= 1) {
+            bucket++;
+        }
+        buckets[counter][min(bucket,kNumBuckets - 1)]++;
+    }
+}
+
+long long SearchStatsHistogram::numSearches() const {
+    long long total = 0;
+    for (int bucket = 0; bucket < kNumBuckets; ++bucket) {
+        total += buckets[0][bucket];
+    }
+    return total;
+}
+
+long long SearchStatsHistogram::count(StatsCounter counter, int bucket) const {
+    return buckets[counter][bucket];
+}
 
-    Set<RoadNode*> mainPathSet;
-    for (RoadNode* eachNode: mainPath) {
-        mainPathSet+=eachNode;
+//upper end of the bucket holding the given fraction (e.g. 0.99) of searches, 0 if none
+long long SearchStatsHistogram::percentile(StatsCounter counter, double fraction) const {
+    long long wanted = llround(ceil(fraction*numSearches()));
+    long long seen = 0;
+    for (int bucket = 0; bucket < kNumBuckets; ++bucket) {
+        seen += buckets[counter][bucket];
+        if (seen >= wanted && seen > 0) {
+            if (bucket == 0) return 0;
+            return bucket < 63 ? (1LL << bucket) - 1 : LLONG_MAX;
+        }
     }
+    return 0;
+}
 
-    Set<RoadNode*> altPathSet;
-    for (RoadNode* eachNode2: altPath) {
-        altPathSet+=eachNode2;
+//prints one line per counter with its median, 90th, 99th percentile and maximum
+void SearchStatsHistogram::print(ostream& out) const {
+    static const char* const kNames[NUM_STATS_COUNTERS] = {
+        "nodes settled", "edges relaxed", "heap pushes", "heap pops", "peak frontier",
+        "bytes allocated", "microseconds"
+    };
+    out << numSearches() << " searches" << endl;
+    out << left << setw(18) << "" << right << setw(12) << "p50" << setw(12) << "p90"
+        << setw(12) << "p99" << setw(12) << "max" << endl;
+    for (int counter = 0; counter < NUM_STATS_COUNTERS; ++counter) {
+        StatsCounter each = StatsCounter(counter);
+        out << left << setw(18) << kNames[counter] << right
+            << setw(12) << percentile(each,0.50) << setw(12) << percentile(each,0.90)
+            << setw(12) << percentile(each,0.99) << setw(12) << percentile(each,1.0) << endl;
     }
+}
 
-    Set<RoadNode*> uniqueElems = altPathSet - mainPathSet;
 
-    int numUniqueElems = uniqueElems.size();
-    int numNodesAltPath = altPath.size();
 
-    if (double(numUniqueElems)/double(numNodesAltPath) >= 0.20) {
-        return true;
-    } else {
-        return false;
+//converts snapshot node IDs back into a Path of RoadNodes
+Path toPath(const RoadGraphSnapshot& snapshot, const vector<int>& ids) {
+    Path path;
+    for (int id : ids) {
+        path += snapshot.nodes[id];
     }
+    return path;
 }
@@ -0,0 +1,590 @@
+/* Public interface of Pathfinding_Algorithms.cpp: the snapshot, context and preprocessing
+ * types, and every search entry point. The RoadGraph versions search the graph's cached
+ * snapshot and color it for the visualizer; the SearchContext versions search whatever
+ * snapshot the context was made for, and the versions on node IDs also work on snapshots
+ * built from edge lists, which have no RoadNodes (see buildSnapshot).
+ */
+
+#pragma once
+
+#include "Trailblazer.h"
+#include "grid.h"
+#include "hashmap.h"
+#include "vector.h"
+#include <cfloat>
+#include <cstdint>
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <memory>
+#include <mutex>
+#include <ostream>
+#include <string>
+#include <thread>
+#include <vector>
+
+
+const int kNoParent = -1;
+const int kNotQueued = -1;
+const int kNoEdge = -1;
+const double kMinUniqueFraction = 0.20;     //share of an alternative route's nodes that must be new
+const double kMaxAlternativeStretch = 1.25; //most an alternative route may cost, times the optimal
+
+
+/* Compressed-sparse-row copy of a RoadGraph, built once and then shared read-only by every
+ * query. Nodes get dense IDs 0..n-1, and the outgoing edges of node v are the index range
+ * [firstEdge[v], firstEdge[v+1]) of the edgeTarget/edgeCost arrays, so expanding a node
+ * walks two contiguous arrays instead of asking the graph for a neighbor container and
+ * looking each edge up by its endpoints. The same edges are also stored grouped by target
+ * node (firstInEdge/inEdgeSource/inEdgeCost) for searches that run backward from the end.
+ * Snapshots built straight from an edge list (benchmarks, files) have no RoadGraph or
+ * RoadNodes behind them; their nodes are null and the heuristic uses nodeX/nodeY instead.
+ */
+struct RoadGraphSnapshot {
+    const RoadGraph* graph = nullptr;
+    double maxRoadSpeed = 1.0;
+
+    HashMap<RoadNode*,int> nodeIds;
+    std::vector<RoadNode*> nodes;
+    std::vector<double> nodeX;
+    std::vector<double> nodeY;
+    std::vector<int> firstEdge;
+    std::vector<int> edgeTarget;
+    std::vector<double> edgeCost;
+    std::vector<int> firstInEdge;
+    std::vector<int> inEdgeSource;
+    std::vector<double> inEdgeCost;
+
+    int numNodes() const {
+        return nodes.size();
+    }
+
+    int idOf(RoadNode* node) const;
+    int edgeBetween(int from, int to) const;
+    double heuristic(int from, int to) const;
+};
+
+/* Landmark distance tables for the ALT (A*, Landmarks, Triangle inequality) heuristic.
+ * For every landmark L the table stores the cost from L to every node and from every node
+ * to L, laid out node by node so that one lookup touches a single contiguous block. By the
+ * triangle inequality, d(L,t) - d(L,v) and d(v,L) - d(t,L) are both lower bounds on the
+ * cost from v to t; on graphs with a few very fast roads these bounds are much tighter
+ * than crow-fly distance divided by the top speed.
+ */
+struct LandmarkTable {
+    int numNodes = 0;
+    std::vector<int> landmarks;
+    std::vector<double> fromLandmark;    //fromLandmark[v*k + i] is the cost from landmark i to v
+    std::vector<double> toLandmark;      //toLandmark[v*k + i] is the cost from v to landmark i
+    uint64_t graphFingerprint = 0;
+
+    double lowerBound(int from, int to) const;
+    bool save(const std::string& fileName) const;
+    bool load(const RoadGraphSnapshot& snapshot, const std::string& fileName);
+};
+
+/* Contraction hierarchy over a snapshot. Preprocessing removes ("contracts") nodes one at
+ * a time in order of importance, adding a shortcut arc u->w whenever the only shortest
+ * path from u to w ran through the removed node. A query then only has to search upward
+ * in that order from both ends, which touches a few hundred nodes even on continental
+ * maps; shortcuts remember the node they bypass (middle) so paths can be unpacked.
+ *
+ * All arrays live in one flat image with the same layout as the file written by save,
+ * so load can memory-map a file and point straight into it without copying. For node v,
+ * up arcs [upFirst[v], upFirst[v+1]) lead to higher-ranked nodes, and down arcs
+ * [downFirst[v], downFirst[v+1]) come from higher-ranked nodes into v.
+ */
+struct ContractionHierarchy {
+    int numNodes = 0;
+    int numUpArcs = 0;
+    int numDownArcs = 0;
+    uint64_t graphFingerprint = 0;
+
+    const int* rank = nullptr;
+    const int* upFirst = nullptr;
+    const int* upTarget = nullptr;
+    const int* upMiddle = nullptr;
+    const double* upCost = nullptr;
+    const int* downFirst = nullptr;
+    const int* downSource = nullptr;
+    const int* downMiddle = nullptr;
+    const double* downCost = nullptr;
+
+    ContractionHierarchy() {}
+    ContractionHierarchy(ContractionHierarchy&& other);
+    ContractionHierarchy& operator=(ContractionHierarchy&& other);
+    ContractionHierarchy(const ContractionHierarchy&) = delete;
+    ContractionHierarchy& operator=(const ContractionHierarchy&) = delete;
+    ~ContractionHierarchy();
+
+    int middleOf(int from, int to) const;
+    bool save(const std::string& fileName) const;
+    bool load(const RoadGraphSnapshot& snapshot, const std::string& fileName);
+    bool attach(const char* image, size_t imageSize);
+
+    std::vector<uint64_t> ownedImage;    //image built in memory (or read without mmap)
+    void* mappedImage = nullptr;    //image mapped from a file
+    size_t mappedSize = 0;
+};
+
+//travel time for leaving along an edge at a given time (one breakpoint of a profile)
+struct ProfilePoint {
+    double departure;
+    double travelTime;
+};
+
+/* Time-dependent travel times for some of a snapshot's edges. Each profile is a piecewise-
+ * linear function of departure time through its points (constant before the first and
+ * after the last); edges without one keep their static cost. Profiles must be FIFO
+ * (leaving later never gets you there earlier), which is what lets a time-dependent
+ * Dijkstra settle each node once. heuristicScale is the smallest ratio of profile travel
+ * time to static cost seen so far; A* multiplies crow-fly estimates by it so that they
+ * stay below the real travel time. Profiles are indexed by the edges of snapshot and can
+ * only be used in searches over that same snapshot.
+ */
+struct TravelTimeProfiles {
+    TravelTimeProfiles(const RoadGraphSnapshot& snapshot);
+
+    const RoadGraphSnapshot& snapshot;
+    std::vector<std::vector<ProfilePoint>> pointsOf;      //per snapshot edge, by departure time
+    double heuristicScale = 1.0;
+
+    bool setProfile(int from, int to, const std::vector<ProfilePoint>& points);
+    double travelTime(int edge, double departure) const;
+};
+
+//an edge whose cost was changed by updateEdgeCosts
+struct EdgeCostChange {
+    int from;
+    int to;
+    int edge;
+    double oldCost;
+    double newCost;
+};
+
+/* Indexed d-ary min-heap keyed by node ID, used as the frontier of the cost-ordered
+ * searches. Each node is in the heap at most once: pushing a node that is already queued
+ * with a lower priority moves it up in place (decrease-key) instead of adding a duplicate,
+ * so the heap never grows past the number of reached nodes. A wider node (Arity 4 by
+ * default) makes the heap shallower and keeps each node's children in one cache line.
+ */
+template <int Arity = 4>
+class IndexedHeap {
+public:
+    bool isEmpty() const {
+        return heap.empty();
+    }
+
+    //inserts id with the given priority, or lowers its priority if it is already queued
+    void pushOrDecrease(int id, double priority) {
+        if (id >= int(position.size())) {
+            position.resize(id+1,kNotQueued);
+        }
+        int slot = position[id];
+        if (slot == kNotQueued) {
+            slot = heap.size();
+            heap.push_back({id,priority});
+            position[id] = slot;
+        } else if (priority < heap[slot].priority) {
+            heap[slot].priority = priority;
+        } else {
+            return;
+        }
+        siftUp(slot);
+    }
+
+    //empties the heap in time proportional to the number of entries left in it
+    void clear() {
+        for (const Slot& slot : heap) {
+            position[slot.id] = kNotQueued;
+        }
+        heap.clear();
+    }
+
+    int size() const {
+        return heap.size();
+    }
+
+    //bytes reserved by the heap's arrays
+    size_t capacityBytes() const {
+        return heap.capacity()*sizeof(Slot) + position.capacity()*sizeof(int);
+    }
+
+    //lowest priority in the heap; the heap must not be empty
+    double minPriority() const {
+        return heap[0].priority;
+    }
+
+    //removes and returns the ID with the lowest priority
+    int popMin() {
+        int id = heap[0].id;
+        position[id] = kNotQueued;
+        heap[0] = heap.back();
+        heap.pop_back();
+        if (!heap.empty()) {
+            position[heap[0].id] = 0;
+            siftDown(0);
+        }
+        return id;
+    }
+
+private:
+    struct Slot {
+        int id;
+        double priority;
+    };
+
+    std::vector<Slot> heap;
+    std::vector<int> position;   //slot in heap for each node ID, kNotQueued if absent
+
+    void siftUp(int slot) {
+        Slot moving = heap[slot];
+        while (slot > 0) {
+            int parentSlot = (slot-1)/Arity;
+            if (heap[parentSlot].priority <= moving.priority) break;
+            heap[slot] = heap[parentSlot];
+            position[heap[slot].id] = slot;
+            slot = parentSlot;
+        }
+        heap[slot] = moving;
+        position[moving.id] = slot;
+    }
+
+    void siftDown(int slot) {
+        Slot moving = heap[slot];
+        int count = heap.size();
+        while (true) {
+            int firstChild = slot*Arity + 1;
+            if (firstChild >= count) break;
+            int lastChild = std::min(firstChild + Arity, count);
+            int bestChild = firstChild;
+            for (int child = firstChild+1; child < lastChild; ++child) {
+                if (heap[child].priority < heap[bestChild].priority) bestChild = child;
+            }
+            if (moving.priority <= heap[bestChild].priority) break;
+            heap[slot] = heap[bestChild];
+            position[heap[slot].id] = slot;
+            slot = bestChild;
+        }
+        heap[slot] = moving;
+        position[moving.id] = slot;
+    }
+};
+
+
+/* Work done by searches, as filled in through a context's stats (see SearchRecorder).
+ * Counts add up over every search run with the same stats until clear is called, except
+ * peakFrontier, which keeps the largest frontier seen. Edges relaxed counts every edge
+ * looked at, pushes include decrease-keys, and bytesAllocated is how much the context's
+ * own buffers grew. Times are wall-clock seconds spent resetting state (setup), in the
+ * main loop (search) and rebuilding the path (path).
+ */
+struct SearchStats {
+    long long numSearches = 0;
+    long long nodesSettled = 0;
+    long long edgesRelaxed = 0;
+    long long heapPushes = 0;
+    long long heapPops = 0;
+    long long peakFrontier = 0;
+    long long bytesAllocated = 0;
+    double setupSeconds = 0.0;
+    double searchSeconds = 0.0;
+    double pathSeconds = 0.0;
+
+    void clear() {
+        *this = SearchStats();
+    }
+
+    SearchStats& operator+=(const SearchStats& other);
+};
+
+enum StatsCounter { NODES_SETTLED, EDGES_RELAXED, HEAP_PUSHES, HEAP_POPS, PEAK_FRONTIER,
+                    BYTES_ALLOCATED, MICROSECONDS, NUM_STATS_COUNTERS };
+
+/* Histograms of per-search stats over many searches, one per StatsCounter, with
+ * power-of-two buckets: bucket 0 counts searches where the value was 0 and bucket b > 0
+ * those where it was in [2^(b-1), 2^b). Attach one to a context's histogram to have every
+ * search added automatically; percentiles are the upper end of the bucket they fall in,
+ * which is plenty to spot the queries that blow up.
+ */
+class SearchStatsHistogram {
+public:
+    void add(const SearchStats& search);
+    long long numSearches() const;
+    long long count(StatsCounter counter, int bucket) const;
+    long long percentile(StatsCounter counter, double fraction) const;
+    void print(std::ostream& out) const;
+
+private:
+    static const int kNumBuckets = 64;
+
+    long long buckets[NUM_STATS_COUNTERS][kNumBuckets] = {};
+};
+
+/* Receives a search's progress, e.g. to color the map while the search runs. Searches
+ * that are given no observer (headless runs) skip these calls entirely.
+ */
+class SearchObserver {
+public:
+    virtual ~SearchObserver() {}
+    virtual void nodeReached(int id) = 0;
+    virtual void nodeSettled(int id) = 0;
+};
+
+/* Reusable state for one search at a time over a snapshot. Predecessor, g-score (cost
+ * from the start node) and the memoized crow-fly heuristic toward the end node live in
+ * flat arrays indexed by snapshot node ID. Instead of clearing those arrays, every query
+ * bumps a generation counter: a node counts as reached (or settled, or as having its
+ * heuristic computed) only if its stamp equals the current generation, so starting a new
+ * query is O(1). Searches never touch the shared RoadNodes themselves, so one context
+ * per thread allows concurrent queries on the same snapshot; coloring only happens
+ * through the optional observer. If landmarks is set, the heuristic also uses the ALT
+ * lower bound. A context that searches backward from the end node estimates costs from
+ * its endId to each node instead of the reverse. Every search run in the context adds
+ * its work to stats and to histogram, if set; searches over two contexts (bidirectional,
+ * contraction hierarchy, alternativeRoutes) count once, in the forward one. markStamp is
+ * stamped scratch space for flagging nodes between searches (see newMark).
+ */
+struct SearchContext {
+    SearchContext(const RoadGraphSnapshot& snapshot, SearchObserver* observer = nullptr);
+
+    const RoadGraphSnapshot& snapshot;
+    SearchObserver* observer;
+    const LandmarkTable* landmarks = nullptr;
+    SearchStats* stats = nullptr;
+    SearchStatsHistogram* histogram = nullptr;
+    bool searchesBackward = false;
+    IndexedHeap<> frontier;
+
+    int endId = -1;
+    uint32_t generation = 0;
+    std::vector<uint32_t> reachedStamp;
+    std::vector<uint32_t> settledStamp;
+    std::vector<uint32_t> heuristicStamp;
+    std::vector<int> parent;
+    std::vector<double> gScore;
+    std::vector<double> hScore;
+    uint32_t markGeneration = 0;
+    std::vector<uint32_t> markStamp;
+
+    void beginQuery(int endNode);
+    uint32_t newMark();
+
+    bool isReached(int id) const {
+        return reachedStamp[id] == generation;
+    }
+
+    bool isSettled(int id) const {
+        return settledStamp[id] == generation;
+    }
+
+    double costTo(int id) const {
+        return isReached(id) ? gScore[id] : DBL_MAX;
+    }
+
+    void markReached(int id, int parentId, double cost);
+    void markSettled(int id);
+    double heuristic(int id);
+    std::vector<int> pathTo(int id) const;
+    size_t bufferBytes() const;
+};
+
+/* Shortest-path tree from one source to every node, kept outside any SearchContext so it
+ * can be cached and then repaired when edge costs change instead of being regrown (see
+ * repair). cost[v] is DBL_MAX for nodes the source cannot reach. lostStamp, lostNodes
+ * and frontier are repair's scratch space, kept so that repairs after the first allocate
+ * nothing; a node is cut off in the current repair if its stamp equals lostGeneration
+ * (as with SearchContext::newMark).
+ */
+struct ShortestPathTree {
+    int source = -1;
+    std::vector<double> cost;
+    std::vector<int> parent;
+    uint32_t lostGeneration = 0;
+    std::vector<uint32_t> lostStamp;
+    std::vector<int> lostNodes;
+    IndexedHeap<> frontier;
+
+    void grow(SearchContext& context, int sourceId);
+    void repair(const RoadGraphSnapshot& snapshot, const std::vector<EdgeCostChange>& changes);
+    std::vector<int> pathTo(int id) const;
+};
+
+//one edge of a graph given as an edge list (see buildSnapshot)
+struct SnapshotEdge {
+    int from;
+    int to;
+    double cost;
+};
+
+enum RouteAlgorithm { BREADTH_FIRST_ROUTE, DIJKSTRA_ROUTE, A_STAR_ROUTE, ALTERNATIVE_ROUTE };
+
+//one route to compute in a batch handed to a RouteQueryExecutor
+struct RouteRequest {
+    RoadNode* start;
+    RoadNode* end;
+    RouteAlgorithm algorithm;
+};
+
+/* Answers batches of route requests on a fixed pool of worker threads. The executor keeps
+ * its own snapshot of the graph, which the workers only ever read, and each worker owns a
+ * forward and a backward SearchContext that it reuses for every request it takes, so
+ * nothing is allocated per query and no RoadNode is touched (there is no coloring).
+ * Workers pull request indices from a shared counter, which balances long and short
+ * queries, and write each answer into its own slot, so results come back in input order.
+ * run may not be called from two threads at once on the same executor.
+ */
+class RouteQueryExecutor {
+public:
+    RouteQueryExecutor(const RoadGraph& graph, int numThreads = 0);
+    ~RouteQueryExecutor();
+    RouteQueryExecutor(const RouteQueryExecutor&) = delete;
+    RouteQueryExecutor& operator=(const RouteQueryExecutor&) = delete;
+
+    Vector<Path> run(const Vector<RouteRequest>& requests);
+
+    int numThreads() const {
+        return workers.size();
+    }
+
+private:
+    void workerLoop(int worker);
+
+    RoadGraphSnapshot snapshot;
+    std::vector<std::unique_ptr<SearchContext>> forwardContexts;
+    std::vector<std::unique_ptr<SearchContext>> backwardContexts;
+    std::vector<std::thread> workers;
+
+    std::mutex lock;
+    std::condition_variable batchReady;
+    std::condition_variable batchDone;
+    uint64_t batchNumber = 0;
+    int busyWorkers = 0;
+    bool isStopping = false;
+
+    const Vector<RouteRequest>* batch = nullptr;
+    std::vector<Path> answers;
+    std::atomic<int> nextRequest{0};
+};
+
+
+//snapshots
+RoadGraphSnapshot buildSnapshot(const RoadGraph& graph);
+
+RoadGraphSnapshot buildSnapshot(const std::vector<double>& x, const std::vector<double>& y,
+                                const std::vector<SnapshotEdge>& edges);
+
+std::shared_ptr<const RoadGraphSnapshot> snapshotOf(const RoadGraph& graph);
+
+void forgetSnapshot(const RoadGraph& graph);
+
+uint64_t fingerprintOf(const RoadGraphSnapshot& snapshot);
+
+std::vector<EdgeCostChange> updateEdgeCosts(RoadGraphSnapshot& snapshot,
+                                            const std::vector<SnapshotEdge>& newCosts);
+
+//searches on a RoadGraph (breadthFirstSearch, dijkstrasAlgorithm, aStar and
+//alternativeRoute are declared in Trailblazer.h)
+Path aStar(const RoadGraph& graph, RoadNode* start, RoadNode* end,
+           const LandmarkTable& landmarks);
+
+Path dijkstrasAlgorithmBucketed(const RoadGraph& graph, RoadNode* start, RoadNode* end,
+                                double costResolution);
+
+Path breadthFirstSearchDirectionOptimizing(const RoadGraph& graph, RoadNode* start,
+                                           RoadNode* end, int numThreads = 1);
+
+Path bidirectionalDijkstra(const RoadGraph& graph, RoadNode* start, RoadNode* end);
+
+Path bidirectionalAStar(const RoadGraph& graph, RoadNode* start, RoadNode* end);
+
+Path contractionHierarchyQuery(const RoadGraph& graph, const ContractionHierarchy& hierarchy,
+                               RoadNode* start, RoadNode* end);
+
+Vector<Path> alternativeRoutes(const RoadGraph& graph, RoadNode* start, RoadNode* end,
+                               int numAlternatives, double minUniqueFraction = kMinUniqueFraction,
+                               double maxStretch = kMaxAlternativeStretch);
+
+Path timeDependentDijkstra(const RoadGraph& graph, const TravelTimeProfiles& profiles,
+                           RoadNode* start, RoadNode* end, double departureTime,
+                           double* arrivalTime = nullptr);
+
+Path timeDependentAStar(const RoadGraph& graph, const TravelTimeProfiles& profiles,
+                        RoadNode* start, RoadNode* end, double departureTime,
+                        double* arrivalTime = nullptr);
+
+Grid<double> distanceMatrix(const RoadGraph& graph, const Vector<RoadNode*>& sources,
+                            const Vector<RoadNode*>& targets, Grid<Path>* paths = nullptr);
+
+Grid<double> distanceMatrix(const RoadGraph& graph, const ContractionHierarchy& hierarchy,
+                            const Vector<RoadNode*>& sources, const Vector<RoadNode*>& targets);
+
+void recordSearchStats(const RoadGraph& graph, SearchStats* stats,
+                       SearchStatsHistogram* histogram = nullptr);
+
+//searches in caller-owned contexts
+Path breadthFirstSearch(SearchContext& context, RoadNode* start, RoadNode* end);
+
+Path dijkstrasAlgorithm(SearchContext& context, RoadNode* start, RoadNode* end);
+
+Path aStar(SearchContext& context, RoadNode* start, RoadNode* end);
+
+Path bidirectionalDijkstra(SearchContext& forward, SearchContext& backward,
+                           RoadNode* start, RoadNode* end);
+
+Path bidirectionalAStar(SearchContext& forward, SearchContext& backward,
+                        RoadNode* start, RoadNode* end);
+
+Path contractionHierarchyQuery(const ContractionHierarchy& hierarchy, SearchContext& forward,
+                               SearchContext& backward, RoadNode* start, RoadNode* end);
+
+Path alternativeRoute(SearchContext& forward, SearchContext& backward,
+                      RoadNode* start, RoadNode* end);
+
+Vector<Path> alternativeRoutes(SearchContext& forward, SearchContext& backward,
+                               RoadNode* start, RoadNode* end,
+                               int numAlternatives, double minUniqueFraction = kMinUniqueFraction,
+                               double maxStretch = kMaxAlternativeStretch);
+
+Path timeDependentDijkstra(SearchContext& context, const TravelTimeProfiles& profiles,
+                           RoadNode* start, RoadNode* end, double departureTime,
+                           double* arrivalTime = nullptr);
+
+Path timeDependentAStar(SearchContext& context, const TravelTimeProfiles& profiles,
+                        RoadNode* start, RoadNode* end, double departureTime,
+                        double* arrivalTime = nullptr);
+
+Grid<double> distanceMatrix(SearchContext& context, const Vector<RoadNode*>& sources,
+                            const Vector<RoadNode*>& targets, Grid<Path>* paths = nullptr);
+
+Grid<double> distanceMatrix(const ContractionHierarchy& hierarchy, SearchContext& context,
+                            const Vector<RoadNode*>& sources, const Vector<RoadNode*>& targets);
+
+//the same searches on snapshot node IDs: they return the IDs along the path (empty if
+//there is none) and write its cost to pathCost (DBL_MAX if there is none) when given
+std::vector<int> breadthFirstSearch(SearchContext& context, int start, int end);
+
+std::vector<int> dijkstrasAlgorithm(SearchContext& context, int start, int end,
+                                    double* pathCost = nullptr);
+
+std::vector<int> aStar(SearchContext& context, int start, int end, double* pathCost = nullptr);
+
+std::vector<int> bidirectionalDijkstra(SearchContext& forward, SearchContext& backward,
+                                       int start, int end, double* pathCost = nullptr);
+
+std::vector<int> bidirectionalAStar(SearchContext& forward, SearchContext& backward,
+                                    int start, int end, double* pathCost = nullptr);
+
+std::vector<int> contractionHierarchyQuery(const ContractionHierarchy& hierarchy,
+                                           SearchContext& forward, SearchContext& backward,
+                                           int start, int end, double* pathCost = nullptr);
+
+std::vector<std::vector<int>> alternativeRoutes(SearchContext& forward, SearchContext& backward,
+                                                int start, int end, int numAlternatives,
+                                                double minUniqueFraction = kMinUniqueFraction,
+                                                double maxStretch = kMaxAlternativeStretch);
+
+//preprocessing
+LandmarkTable buildLandmarks(const RoadGraphSnapshot& snapshot, int numLandmarks);
+
+ContractionHierarchy buildContractionHierarchy(const RoadGraphSnapshot& snapshot);
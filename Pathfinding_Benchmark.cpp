@@ -0,0 +1,412 @@
+/* Benchmark for Pathfinding_Algorithms.cpp. Builds a road graph snapshot, runs the same
+ * fixed-seed set of random queries through breadth-first search, Dijkstra's algorithm,
+ * A*, alternativeRoute, a contraction hierarchy (after preprocessing) and bidirectional
+ * Dijkstra and A*, and reports latency percentiles, queries per second, nodes settled per
+ * query and peak memory. It also checks that the algorithms agree: A*, the hierarchy and
+ * both bidirectional searches must return a path from start to end with the same optimal
+ * cost as Dijkstra's, breadth-first search a path from start to end of no more hops than
+ * Dijkstra's, and every alternative route a path from start to end that costs at least
+ * the optimal cost and at most kMaxAlternativeStretch times it, with at least
+ * kMinUniqueFraction of its nodes off Dijkstra's path. The hierarchy may not add
+ * more than kMaxShortcutsPerEdge shortcuts per road. The exit status is 1 if any check
+ * fails, so the benchmark can gate changes to the routing code.
+ *
+ * Every query goes through the public entry points in Pathfinding_Algorithms.h. The timed
+ * pass runs with no stats attached; nodes settled are counted in a second, untimed pass
+ * with the stats attached to both search directions. Build it with the library, e.g.
+ *     g++ -std=c++17 -O2 -pthread -I<Stanford library headers> Pathfinding_Benchmark.cpp \
+ *         Pathfinding_Algorithms.cpp
+ *
+ * Usage: pathfinding_benchmark grid|geometric|FILE.gr [numNodes] [numQueries] [seed]
+ *   grid       square grid, every road open both ways
+ *   geometric  random points joined to every other point within 1.5 units
+ *   FILE.gr    DIMACS shortest-path graph ("a u v cost" lines), with coordinates read
+ *              from FILE.co ("v id x y" lines) if it exists
+ */
+
+#include "Pathfinding_Algorithms.h"
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <random>
+#include <sstream>
+#ifndef _WIN32
+#include <sys/resource.h>
+#endif
+using namespace std;
+
+const int kMaxShortcutsPerEdge = 4;
+
+//Prototypes of helper functions
+RoadGraphSnapshot buildGridGraph(int numNodes, mt19937& random);
+RoadGraphSnapshot buildGeometricGraph(int numNodes, mt19937& random);
+bool loadDimacsGraph(const string& fileName, RoadGraphSnapshot& snapshot);
+double costOf(const RoadGraphSnapshot& snapshot, const vector<int>& path);
+bool isRouteBetween(const RoadGraphSnapshot& snapshot, const vector<int>& path, int start, int end);
+double uniqueFraction(const vector<int>& route, vector<int> mainPath);
+vector<int> runAlgorithm(int algorithm, const ContractionHierarchy& hierarchy,
+                         SearchContext& forward, SearchContext& backward,
+                         int start, int end, double& cost, vector<vector<int>>& alternatives);
+double peakMemoryMegabytes();
+void printResults(const string& name, vector<double>& latencies, long long nodesSettled);
+
+
+int main(int argc, char* argv[]) {
+
+    int numNodes = argc > 2 ? atoi(argv[2]) : 100000;
+    int numQueries = argc > 3 ? atoi(argv[3]) : 200;
+    unsigned seed = argc > 4 ? atoi(argv[4]) : 1;
+    if (argc < 2 || numNodes < 1 || numQueries < 1) {
+        cout << "Usage: " << argv[0]
+             << " grid|geometric|FILE.gr [numNodes] [numQueries] [seed]" << endl;
+        return 2;
+    }
+    string graphKind = argv[1];
+    mt19937 random(seed);
+
+    //build (or load) the graph
+    RoadGraphSnapshot snapshot;
+    if (graphKind == "grid") {
+        snapshot = buildGridGraph(numNodes,random);
+    } else if (graphKind == "geometric") {
+        snapshot = buildGeometricGraph(numNodes,random);
+    } else if (!loadDimacsGraph(graphKind,snapshot)) {
+        cout << "Could not read " << graphKind << endl;
+        return 2;
+    }
+    if (snapshot.numNodes() == 0) {
+        cout << "The graph has no nodes" << endl;
+        return 2;
+    }
+    cout << graphKind << ": " << snapshot.numNodes() << " nodes, " << snapshot.edgeTarget.size()
+         << " edges, " << numQueries << " queries, seed " << seed << endl;
+
+    vector<pair<int,int>> queries;
+    uniform_int_distribution<int> anyNode(0,snapshot.numNodes() - 1);
+    for (int i = 0; i < numQueries; ++i) {
+        int start = anyNode(random);
+        queries.push_back({start,anyNode(random)});
+    }
+
+    //contraction hierarchy preprocessing; road-like graphs need a few shortcuts per road
+    //at most, so many more than that means the witness searches are not pruning anything
+    chrono::steady_clock::time_point preprocessBegan = chrono::steady_clock::now();
+    ContractionHierarchy hierarchy = buildContractionHierarchy(snapshot);
+    double preprocessSeconds = chrono::duration<double>(chrono::steady_clock::now()
+                                                        - preprocessBegan).count();
+    long long numShortcuts = (long long)(hierarchy.numUpArcs) + hierarchy.numDownArcs
+                             - (long long)(snapshot.edgeTarget.size());
+    cout << "contraction hierarchy: " << numShortcuts << " shortcuts, built in " << fixed
+         << setprecision(2) << preprocessSeconds << " s" << endl;
+    int numFailures = 0;
+    if (numShortcuts > kMaxShortcutsPerEdge*(long long)(snapshot.edgeTarget.size())) {
+        cout << "too many shortcuts" << endl;
+        numFailures++;
+    }
+
+    SearchContext forward(snapshot);
+    SearchContext backward(snapshot);
+    SearchStats stats;
+
+    //run every algorithm over the same queries, remembering what the checks need
+    vector<double> optimalCost(numQueries);
+    vector<vector<int>> optimalPaths(numQueries);
+    const char* const kNames[] = { "breadthFirstSearch", "dijkstrasAlgorithm", "aStar",
+                                   "alternativeRoute", "contractionHierarchy",
+                                   "bidirectionalDijkstra", "bidirectionalAStar" };
+
+    for (int algorithm : {1, 0, 2, 3, 4, 5, 6}) {
+        vector<double> latencies;
+        forward.stats = nullptr;
+        backward.stats = nullptr;
+
+        for (int i = 0; i < numQueries; ++i) {
+            int start = queries[i].first;
+            int end = queries[i].second;
+            double cost = DBL_MAX;
+            vector<vector<int>> alternatives;
+            chrono::steady_clock::time_point began = chrono::steady_clock::now();
+            vector<int> path = runAlgorithm(algorithm,hierarchy,forward,backward,start,end,
+                                            cost,alternatives);
+            latencies.push_back(chrono::duration<double>(chrono::steady_clock::now() - began).count());
+
+            //cross-check against Dijkstra's optimal cost; paths must also be real
+            //paths from start to end that cost what their search says they do
+            if (algorithm == 1) {
+                optimalCost[i] = cost;
+                optimalPaths[i] = path;
+            } else if (algorithm == 0) {
+                if (path.empty() != optimalPaths[i].empty()
+                        || (!path.empty() && (!isRouteBetween(snapshot,path,start,end)
+                                              || path.size() > optimalPaths[i].size()))) {
+                    numFailures++;
+                }
+            } else if (algorithm == 2 || algorithm >= 4) {
+                bool isOptimal = cost == optimalCost[i]
+                                 || fabs(cost - optimalCost[i]) <= 1e-9*max(1.0,cost);
+                bool isConnected = path.empty() ? cost == DBL_MAX
+                                                : path.front() == start && path.back() == end;
+                if (!isOptimal || !isConnected
+                        || (!path.empty() && fabs(costOf(snapshot,path) - cost) > 1e-9*max(1.0,cost))) {
+                    numFailures++;
+                }
+            } else if (algorithm == 3 && !alternatives.empty()) {
+                const vector<int>& route = alternatives[0];
+                double altCost = costOf(snapshot,route);
+                double tolerance = 1e-9*max(1.0,optimalCost[i]);
+                if (!isRouteBetween(snapshot,route,start,end)
+                        || altCost < optimalCost[i] - tolerance
+                        || altCost > kMaxAlternativeStretch*optimalCost[i] + tolerance
+                        || uniqueFraction(route,optimalPaths[i]) < kMinUniqueFraction) {
+                    numFailures++;
+                }
+            }
+        }
+
+        //count the work in a separate pass so the counters stay out of the timings
+        stats.clear();
+        forward.stats = &stats;
+        backward.stats = &stats;
+        for (const pair<int,int>& query : queries) {
+            double cost = DBL_MAX;
+            vector<vector<int>> alternatives;
+            runAlgorithm(algorithm,hierarchy,forward,backward,query.first,query.second,
+                         cost,alternatives);
+        }
+        printResults(kNames[algorithm],latencies,stats.nodesSettled);
+    }
+
+    cout << "peak memory: " << fixed << setprecision(1) << peakMemoryMegabytes() << " MB" << endl;
+    if (numFailures > 0) {
+        cout << numFailures << " queries failed a check" << endl;
+        return 1;
+    }
+    cout << "all checks passed" << endl;
+    return 0;
+}
+
+
+/* Runs query number algorithm of kNames from start to end. Searches that report a cost
+ * store it in cost; alternativeRoute fills alternatives instead of returning a path.
+ */
+vector<int> runAlgorithm(int algorithm, const ContractionHierarchy& hierarchy,
+                         SearchContext& forward, SearchContext& backward,
+                         int start, int end, double& cost, vector<vector<int>>& alternatives) {
+    switch (algorithm) {
+    case 0:
+        return breadthFirstSearch(forward,start,end);
+    case 1:
+        return dijkstrasAlgorithm(forward,start,end,&cost);
+    case 2:
+        return aStar(forward,start,end,&cost);
+    case 3:
+        alternatives = alternativeRoutes(forward,backward,start,end,1);
+        return vector<int>();
+    case 4:
+        return contractionHierarchyQuery(hierarchy,forward,backward,start,end,&cost);
+    case 5:
+        return bidirectionalDijkstra(forward,backward,start,end,&cost);
+    default:
+        return bidirectionalAStar(forward,backward,start,end,&cost);
+    }
+}
+
+
+/* Square grid of about numNodes nodes, one unit apart, with a road both ways between
+ * neighbors. Each road costs its length times a random factor between 1 and 2, so the
+ * crow-fly heuristic is admissible but not exact.
+ */
+RoadGraphSnapshot buildGridGraph(int numNodes, mt19937& random) {
+    int side = max(1,int(sqrt(double(numNodes))));
+    uniform_real_distribution<double> slowdown(1.0,2.0);
+    vector<double> x;
+    vector<double> y;
+    vector<SnapshotEdge> edges;
+
+    for (int row = 0; row < side; ++row) {
+        for (int col = 0; col < side; ++col) {
+            x.push_back(col);
+            y.push_back(row);
+            int id = row*side + col;
+            if (col + 1 < side) {
+                edges.push_back({id,id + 1,slowdown(random)});
+                edges.push_back({id + 1,id,slowdown(random)});
+            }
+            if (row + 1 < side) {
+                edges.push_back({id,id + side,slowdown(random)});
+                edges.push_back({id + side,id,slowdown(random)});
+            }
+        }
+    }
+    return buildSnapshot(x,y,edges);
+}
+
+
+/* numNodes random points in a square with about one point per unit of area, each joined
+ * both ways to every point within 1.5 units (about 7 neighbors on average). Points are
+ * bucketed into 1.5 x 1.5 cells so only neighboring cells are compared. Roads cost their
+ * length times a random factor between 1 and 2.
+ */
+RoadGraphSnapshot buildGeometricGraph(int numNodes, mt19937& random) {
+    const double kRadius = 1.5;
+    double side = sqrt(double(numNodes));
+    int numCells = max(1,int(side/kRadius));
+    uniform_real_distribution<double> coordinate(0.0,side);
+    uniform_real_distribution<double> slowdown(1.0,2.0);
+
+    vector<double> x(numNodes);
+    vector<double> y(numNodes);
+    vector<vector<int>> cells(numCells*numCells);
+    auto cellOf = [&](double value) {
+        return min(numCells - 1,int(value/side*numCells));
+    };
+    for (int v = 0; v < numNodes; ++v) {
+        x[v] = coordinate(random);
+        y[v] = coordinate(random);
+        cells[cellOf(y[v])*numCells + cellOf(x[v])].push_back(v);
+    }
+
+    vector<SnapshotEdge> edges;
+    for (int v = 0; v < numNodes; ++v) {
+        int cellX = cellOf(x[v]);
+        int cellY = cellOf(y[v]);
+        for (int dy = -1; dy <= 1; ++dy) {
+            for (int dx = -1; dx <= 1; ++dx) {
+                if (cellX + dx < 0 || cellX + dx >= numCells) continue;
+                if (cellY + dy < 0 || cellY + dy >= numCells) continue;
+                for (int w : cells[(cellY + dy)*numCells + cellX + dx]) {
+                    double length = hypot(x[v] - x[w],y[v] - y[w]);
+                    if (w <= v || length > kRadius) continue;
+                    edges.push_back({v,w,length*slowdown(random)});
+                    edges.push_back({w,v,length*slowdown(random)});
+                }
+            }
+        }
+    }
+    return buildSnapshot(x,y,edges);
+}
+
+
+/* Reads a graph in the DIMACS shortest-path format: a "p sp numNodes numArcs" line, then
+ * one "a from to cost" line per arc, with nodes numbered from 1. Coordinates are read from
+ * the file of the same name ending in .co instead of .gr ("v id x y" lines) if there is
+ * one; otherwise all nodes sit at the origin and A* has no heuristic to work with.
+ */
+bool loadDimacsGraph(const string& fileName, RoadGraphSnapshot& snapshot) {
+    ifstream graphFile(fileName);
+    if (!graphFile) return false;
+
+    int numNodes = 0;
+    vector<SnapshotEdge> edges;
+    string line;
+    while (getline(graphFile,line)) {
+        istringstream fields(line);
+        string kind;
+        fields >> kind;
+        if (kind == "p") {
+            string format;
+            fields >> format >> numNodes;
+        } else if (kind == "a") {
+            SnapshotEdge edge;
+            if (!(fields >> edge.from >> edge.to >> edge.cost)) return false;
+            if (edge.from < 1 || edge.from > numNodes || edge.to < 1 || edge.to > numNodes) {
+                return false;
+            }
+            edge.from--;
+            edge.to--;
+            edges.push_back(edge);
+        }
+    }
+
+    vector<double> x(numNodes,0.0);
+    vector<double> y(numNodes,0.0);
+    if (fileName.size() > 3 && fileName.compare(fileName.size() - 3,3,".gr") == 0) {
+        ifstream coordinateFile(fileName.substr(0,fileName.size() - 3) + ".co");
+        while (getline(coordinateFile,line)) {
+            istringstream fields(line);
+            string kind;
+            int id;
+            double nodeX;
+            double nodeY;
+            fields >> kind;
+            if (kind != "v" || !(fields >> id >> nodeX >> nodeY)) continue;
+            if (id < 1 || id > numNodes) return false;
+            x[id - 1] = nodeX;
+            y[id - 1] = nodeY;
+        }
+    }
+    snapshot = buildSnapshot(x,y,edges);
+    return true;
+}
+
+
+//total cost of the edges along a path, DBL_MAX if two of its nodes are not joined by an edge
+double costOf(const RoadGraphSnapshot& snapshot, const vector<int>& path) {
+    double cost = 0.0;
+    for (size_t k = 1; k < path.size(); ++k) {
+        int e = snapshot.edgeBetween(path[k-1],path[k]);
+        if (e == kNoEdge) return DBL_MAX;
+        cost += snapshot.edgeCost[e];
+    }
+    return cost;
+}
+
+
+//whether path runs from start to end over edges of the snapshot
+bool isRouteBetween(const RoadGraphSnapshot& snapshot, const vector<int>& path, int start, int end) {
+    return !path.empty() && path.front() == start && path.back() == end
+           && costOf(snapshot,path) != DBL_MAX;
+}
+
+
+//share of a route's nodes that are not on mainPath
+double uniqueFraction(const vector<int>& route, vector<int> mainPath) {
+    sort(mainPath.begin(),mainPath.end());
+    int numUniqueNodes = 0;
+    for (int id : route) {
+        if (!binary_search(mainPath.begin(),mainPath.end(),id)) numUniqueNodes++;
+    }
+    return double(numUniqueNodes)/double(route.size());
+}
+
+
+//peak resident memory of this process so far, 0 where it cannot be measured
+double peakMemoryMegabytes() {
+#ifndef _WIN32
+    struct rusage usage;
+    if (getrusage(RUSAGE_SELF,&usage) == 0) {
+#ifdef __APPLE__
+        return usage.ru_maxrss/(1024.0*1024.0);    //bytes on macOS
+#else
+        return usage.ru_maxrss/1024.0;             //kilobytes on Linux
+#endif
+    }
+#endif
+    return 0.0;
+}
+
+
+//prints one algorithm's latency percentiles (in milliseconds), throughput and work
+void printResults(const string& name, vector<double>& latencies, long long nodesSettled) {
+    sort(latencies.begin(),latencies.end());
+    double total = 0.0;
+    for (double seconds : latencies) {
+        total += seconds;
+    }
+    auto percentile = [&](double fraction) {
+        size_t index = min(latencies.size() - 1,size_t(fraction*latencies.size()));
+        return latencies[index]*1000.0;
+    };
+
+    cout << fixed << setprecision(3) << left << setw(22) << name << right
+         << " p50 " << setw(9) << percentile(0.50) << " ms"
+         << "  p90 " << setw(9) << percentile(0.90) << " ms"
+         << "  p99 " << setw(9) << percentile(0.99) << " ms"
+         << "  max " << setw(9) << latencies.back()*1000.0 << " ms"
+         << setprecision(1) << "  " << setw(9) << latencies.size()/max(total,1e-9) << " queries/s"
+         << setprecision(0) << "  " << setw(9) << double(nodesSettled)/latencies.size()
+         << " settled/query" << endl;
+}
@@ -6,69 +6,285 @@
 #include "wikiscraper.h"
 #include <algorithm>
 #include <string>
+#include <list>
+#include <memory>
+#include <fstream>
+#include <sstream>
+#include <set>
+#include <deque>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <chrono>
 
 using std::cout;             using std::endl;
 using std::string;           using std::vector;
 using std::unordered_set;    using std::unordered_map;
 using std::priority_queue;   using std::priority_queue;
+using std::shared_ptr;       using std::list;
+using std::set;              using std::deque;
+
+// link sets kept in memory by default (the least recently used ones are dropped first)
+const size_t kDefaultCacheCapacity = 10000;
+// file the link sets are saved to, so later runs don't fetch the same pages again; a
+// directory of pages (--pages) gets its own store inside that directory
+const string kLinkStoreFile = "wikiladder_links.txt";
+const string kPagesStoreFile = ".links";
+// pages fetched at once by default, and most fetches requested but not yet used
+const int kDefaultFetchWorkers = 8;
+const size_t kDefaultFetchWindow = 64;
+// while a page's links are scored, the children of this many of the best ladders left in
+// the frontier are fetched in the background, ready for when those ladders are extended
+const int kSpeculativeLadders = 3;
+
+/*
+ * Where link sets come from. getLinkSet may be called from several threads at once.
+ */
+class LinkSource {
+public:
+    virtual ~LinkSource() {}
+    virtual unordered_set<string> getLinkSet(const string& page_name) = 0;
+};
+
+// Wikipedia, through WikiScraper (one scraper per thread)
+class WikiScraperSource : public LinkSource {
+public:
+    unordered_set<string> getLinkSet(const string& page_name) override;
+};
+
+/*
+ * Stand-in for Wikipedia that serves pages from a directory: the file named after a page
+ * (with any '/' written as "%2F") lists its links, one per line; a page without a file
+ * has no links. Every fetch first waits latency, to act like a network round trip.
+ */
+class DirectoryLinkSource : public LinkSource {
+public:
+    DirectoryLinkSource(const string& directory, std::chrono::milliseconds latency);
+    unordered_set<string> getLinkSet(const string& page_name) override;
+
+private:
+    string directory;
+    std::chrono::milliseconds latency;
+};
+
+/*
+ * Fetches link sets in the background on numWorkers threads. A page is requested with
+ * request and its links collected with wait (or takeFinished); at most maxInFlight pages
+ * can be requested and not yet collected at once, so speculative fetches can't run far
+ * ahead of the search. Urgent requests are fetched before the others.
+ */
+class LinkPrefetcher {
+public:
+    LinkPrefetcher(LinkSource& source, int numWorkers = kDefaultFetchWorkers,
+                   size_t maxInFlight = kDefaultFetchWindow);
+    ~LinkPrefetcher();
+    LinkPrefetcher(const LinkPrefetcher&) = delete;
+    LinkPrefetcher& operator=(const LinkPrefetcher&) = delete;
+
+    bool request(const string& page_name, bool is_urgent);
+    bool isRequested(const string& page_name) const;
+    unordered_set<string> wait(const string& page_name);
+    vector<std::pair<string, unordered_set<string>>> takeFinished();
+
+private:
+    struct Fetch {
+        bool is_done = false;
+        unordered_set<string> links;
+    };
+
+    void workerLoop();
+
+    LinkSource& source;
+    size_t max_in_flight;
+    mutable std::mutex lock;
+    std::condition_variable work_ready;
+    std::condition_variable fetch_done;
+    deque<string> urgent_queue;
+    deque<string> speculative_queue;
+    unordered_map<string, Fetch> fetches;    // every page requested and not yet collected
+    vector<string> finished;                 // those of them that are done, in order
+    vector<std::thread> workers;
+    bool is_stopping = false;
+};
+
+/*
+ * A cache in front of a LinkSource. Every page name is interned to an integer ID the first
+ * time it is seen, and a page's links are kept as a sorted vector of those IDs, so each
+ * page is fetched and parsed at most once per search. At most capacity link sets are kept
+ * in memory; with a store file, every fetched link set is also appended to that file (one
+ * line per page: the page name, then its links, separated by tabs) and a link set that was
+ * dropped from memory, or fetched by an earlier run, is read back from it instead of being
+ * fetched again. With a prefetcher, pages can be requested ahead of time with prefetch;
+ * links then waits for a requested page instead of fetching it again.
+ */
+class LinkCache {
+public:
+    LinkCache(LinkSource& source, size_t capacity = kDefaultCacheCapacity,
+              const string& store_file = "", LinkPrefetcher* prefetcher = nullptr);
+
+    int idOf(const string& page_name);
+    const string& nameOf(int id) const;
+    shared_ptr<const vector<int>> links(int id);
+    shared_ptr<const vector<int>> cachedLinks(int id) const;
+    bool prefetch(int id, bool is_urgent);
+    void collectPrefetched();
+
+    size_t numFetched() const { return num_fetched; }
+    size_t numStoreReads() const { return num_store_reads; }
+
+private:
+    // a page's links, and its place in the recently-used list while they're in memory
+    struct Entry {
+        shared_ptr<const vector<int>> links;
+        list<int>::iterator lru_position;
+        std::streamoff store_offset = -1;
+    };
+
+    shared_ptr<const vector<int>> readFromStore(std::streamoff offset);
+    vector<int> intern(const unordered_set<string>& link_names);
+    shared_ptr<const vector<int>> addFetched(int id, const unordered_set<string>& link_names);
+    void remember(int id, shared_ptr<const vector<int>> page_links);
+
+    LinkSource& source;
+    LinkPrefetcher* prefetcher;
+    size_t capacity;
+    unordered_map<string, int> ids;
+    vector<string> names;
+    vector<Entry> entries;
+    list<int> recently_used;          // pages with links in memory, most recently used first
+    string store_file;
+    std::fstream store;
+    std::streamoff store_end = 0;     // end of the last complete record in the store file
+    size_t num_fetched = 0;
+    size_t num_store_reads = 0;
+};
+
+/*
+ * Ladders explored by a search, stored as a tree: each step is a page and the index of the
+ * step before it (-1 for the start page), so extending a ladder adds one step instead of
+ * copying the whole ladder.
+ */
+struct LadderStep {
+    int page;
+    int parent;
+};
+
+/*
+ * An entry of the search frontier: a ladder (index of its last step) and its score, the
+ * number of links its last page shares with the end page, computed once when it's added.
+ * Ties go to the ladder added first, so searches are repeatable.
+ */
+struct FrontierEntry {
+    int score;
+    int step;
+
+    bool operator<(const FrontierEntry& other) const {
+        if (score != other.score) return score < other.score;
+        return step > other.step;
+    }
+};
 
 // function prototypes
-vector<string> findWikiLadder(const string&, const string&);
-int getCommonLinks(const vector<string>&, const unordered_set<string>&, WikiScraper&);
+vector<string> findWikiLadder(const string&, const string&, int = 0);
+vector<string> findWikiLadder(const string&, const string&, LinkCache&);
+int countCommonLinks(const vector<int>&, const vector<int>&);
+vector<string> ladderOf(const vector<LadderStep>&, int, const LinkCache&);
 void printLadder(const vector<string>&);
 
 /*
  * This function takes two strings representing the names of a start_page
  * and end_page and returns a ladder, represented as a vector<string>,
  * of links that can be followed from start_page to get to the end_page.
+ * Pages are fetched one at a time unless num_workers is positive, in which
+ * case that many are fetched in parallel (see the overload below).
+ */
+vector<string> findWikiLadder(const string& start_page, const string& end_page, int num_workers) {
+    WikiScraperSource source;
+    std::unique_ptr<LinkPrefetcher> prefetcher;
+    if (num_workers > 0) prefetcher.reset(new LinkPrefetcher(source, num_workers));
+    LinkCache cache(source, kDefaultCacheCapacity, "", prefetcher.get());
+    return findWikiLadder(start_page, end_page, cache);
+}
+
+
+/*
+ * Same as above, with the link sets coming from (and staying in) cache, so several
+ * searches can share the pages they fetch. If the cache has a prefetcher, the search is
+ * pipelined: the children of the page being extended are fetched in parallel, ahead of
+ * being scored, and spare room in the prefetcher's window goes to the children of the
+ * best ladders left in the frontier. The ladder found is the same either way.
  */
-vector<string> findWikiLadder(const string& start_page, const string& end_page) {
+vector<string> findWikiLadder(const string& start_page, const string& end_page, LinkCache& cache) {
 
-    // to keep track of links that have been visited
-    unordered_set<string> visitedLinks;
+    // to keep track of links that have been visited (indexed by page ID)
+    vector<bool> visitedLinks;
 
-    // create WikiScraper object
-    WikiScraper scraper;
-    auto target_set = scraper.getLinkSet(end_page);
+    int end_id = cache.idOf(end_page);
+    auto target_set = cache.links(end_id);
 
-    // lambda function for ladderPQ
-    auto cmpFn = [&scraper,&target_set](const vector<string>& ladderA, const vector<string>& ladderB) -> bool {
-        int num1 = getCommonLinks(ladderA,target_set,scraper);
-        int num2 = getCommonLinks(ladderB,target_set,scraper);
-        return num1 < num2;
-    };
+    // every ladder of the search, and the frontier of ladders still to extend (best last)
+    vector<LadderStep> ladders;
+    set<FrontierEntry> frontier;
+    ladders.push_back({cache.idOf(start_page), -1});
+    frontier.insert({0, 0});
 
-    // creates priority queue and enqueues firstLadder (start_page)
-    priority_queue<vector<string>,vector<vector<string>>,decltype(cmpFn)> ladderPQ(cmpFn);
-    vector<string> firstLadder;
-    firstLadder.push_back(start_page);
-    ladderPQ.push(firstLadder);
+    auto isVisited = [&visitedLinks](int link) {
+        return link < int(visitedLinks.size()) && visitedLinks[link];
+    };
 
-    while(!ladderPQ.empty()) {
+    while(!frontier.empty()) {
 
         // dequeue highest priority ladder
-        vector<string> topLadder = ladderPQ.top();
-        ladderPQ.pop();
-        printLadder(topLadder);
-        string currentPage = topLadder.back();
-        auto currentLinks = scraper.getLinkSet(currentPage);
+        int topStep = frontier.rbegin()->step;
+        frontier.erase(std::prev(frontier.end()));
+        printLadder(ladderOf(ladders, topStep, cache));
+        auto currentLinks = cache.links(ladders[topStep].page);
 
         // check if end_page is in these links; if so, we are done!
-        auto it = currentLinks.find(end_page);
-        if (it!=currentLinks.end()) {
-            topLadder.push_back(end_page);
-            return topLadder;
+        if (std::binary_search(currentLinks->begin(), currentLinks->end(), end_id)) {
+            ladders.push_back({end_id, topStep});
+            return ladderOf(ladders, ladders.size() - 1, cache);
+        }
+
+        // links not found before
+        vector<int> children;
+        for (int link : *currentLinks) {
+            if (link >= int(visitedLinks.size())) visitedLinks.resize(link + 1, false);
+            if (!visitedLinks[link]) {
+                visitedLinks[link] = true;
+                children.push_back(link);
+            }
         }
 
-        for (const auto& link : currentLinks) {
-            auto linkHasBeenVisited = visitedLinks.find(link);
+        // score each child once and add it to the frontier, keeping the children after it
+        // requested from the prefetcher (as far as its window allows)
+        size_t numRequested = 0;
+        for (size_t child = 0; child < children.size(); ++child) {
+            cache.collectPrefetched();
+            numRequested = std::max(numRequested, child);
+            while (numRequested < children.size() && cache.prefetch(children[numRequested], true)) {
+                ++numRequested;
+            }
+            ladders.push_back({children[child], topStep});
+            int score = countCommonLinks(*cache.links(children[child]), *target_set);
+            frontier.insert({score, int(ladders.size()) - 1});
+        }
 
-            // if link was not found
-            if (linkHasBeenVisited == visitedLinks.end()) {
-                visitedLinks.insert(link);
-                auto copyLadder = topLadder;
-                copyLadder.push_back(link);
-                ladderPQ.push(copyLadder);
+        // speculate: start on the pages the next few extensions will need, from the link
+        // sets still in memory only (fetching one here would stall the search)
+        int numCandidates = 0;
+        bool isWindowFull = false;
+        for (auto candidate = frontier.rbegin();
+             candidate != frontier.rend() && numCandidates < kSpeculativeLadders && !isWindowFull;
+             ++candidate, ++numCandidates) {
+            shared_ptr<const vector<int>> candidate_links = cache.cachedLinks(ladders[candidate->step].page);
+            if (!candidate_links) continue;
+            for (int link : *candidate_links) {
+                if (isVisited(link)) continue;
+                if (!cache.prefetch(link, false)) {
+                    isWindowFull = true;
+                    break;
+                }
             }
         }
     }
@@ -76,17 +292,29 @@ vector<string> findWikiLadder(const string& start_page, const string& end_page)
 }
 
 
-// gets common links between last element of ladder and target set
-int getCommonLinks(const vector<string>& ladder, const unordered_set<string>& target, WikiScraper& scraper) {
-    unordered_set<string> setToReturn;
-    string pageName = ladder.back();
-    auto pageLinks = scraper.getLinkSet(pageName);
-    for(auto it=pageLinks.begin(); it!=pageLinks.end(); ++it){
-        if(target.find(*it)!=target.end()){
-            setToReturn.insert(*it);
-        }
+/*
+ * counts the links two pages have in common (both sorted page IDs) without building the
+ * intersection: walks the smaller set and binary-searches the larger one
+ */
+int countCommonLinks(const vector<int>& linksA, const vector<int>& linksB) {
+    const vector<int>& smaller = linksA.size() <= linksB.size() ? linksA : linksB;
+    const vector<int>& larger = linksA.size() <= linksB.size() ? linksB : linksA;
+    int numCommon = 0;
+    for (int link : smaller) {
+        if (std::binary_search(larger.begin(), larger.end(), link)) ++numCommon;
+    }
+    return numCommon;
+}
+
+
+// rebuilds the ladder ending at step as page names, start page first
+vector<string> ladderOf(const vector<LadderStep>& ladders, int step, const LinkCache& cache) {
+    vector<string> ladder;
+    for (; step != -1; step = ladders[step].parent) {
+        ladder.push_back(cache.nameOf(ladders[step].page));
     }
-    return setToReturn.size();
+    std::reverse(ladder.begin(), ladder.end());
+    return ladder;
 }
 
 // print partial ladders
@@ -98,8 +326,387 @@ void printLadder(const vector<string>& ladder) {
 }
 
 
-int main() {
-    auto ladder = findWikiLadder("Milkshake", "Gene");
+/*
+ * Opens (or creates) the store file, if there is one, and indexes the link sets already
+ * in it. Page names can't contain tabs or newlines, so a line that doesn't end in a
+ * newline (a run that stopped while writing) is ignored and later overwritten.
+ */
+LinkCache::LinkCache(LinkSource& source, size_t capacity, const string& store_file,
+                     LinkPrefetcher* prefetcher)
+    : source(source), prefetcher(prefetcher), capacity(std::max<size_t>(capacity, 1)),
+      store_file(store_file) {
+    if (store_file.empty()) return;
+    store.open(store_file, std::ios::in | std::ios::out | std::ios::binary);
+    if (!store) {
+        store.clear();
+        store.open(store_file, std::ios::in | std::ios::out | std::ios::trunc | std::ios::binary);
+    }
+    string line;
+    while (std::getline(store, line)) {
+        if (store.eof()) break;       // no newline: incomplete record
+        int id = idOf(line.substr(0, line.find('\t')));
+        if (id >= int(entries.size())) entries.resize(id + 1);
+        entries[id].store_offset = store_end;
+        store_end += line.size() + 1;
+    }
+    store.clear();
+}
+
+
+// returns the ID of a page, giving it the next free one if it hasn't been seen before
+int LinkCache::idOf(const string& page_name) {
+    auto found = ids.find(page_name);
+    if (found != ids.end()) return found->second;
+    int id = names.size();
+    ids.emplace(page_name, id);
+    names.push_back(page_name);
+    return id;
+}
+
+
+const string& LinkCache::nameOf(int id) const {
+    return names[id];
+}
+
+
+/*
+ * Returns the links of page id as sorted page IDs: from memory, else from the store
+ * file, else from the scraper (in which case they're appended to the store file).
+ */
+shared_ptr<const vector<int>> LinkCache::links(int id) {
+    if (id >= int(entries.size())) entries.resize(id + 1);
+    Entry& entry = entries[id];
+    if (entry.links) {
+        recently_used.splice(recently_used.begin(), recently_used, entry.lru_position);
+        return entry.links;
+    }
+
+    shared_ptr<const vector<int>> page_links;
+    if (entry.store_offset != -1) {
+        page_links = readFromStore(entry.store_offset);
+        ++num_store_reads;
+    }
+    if (!page_links) {
+        if (prefetcher != nullptr && prefetcher->isRequested(names[id])) {
+            return addFetched(id, prefetcher->wait(names[id]));
+        }
+        return addFetched(id, source.getLinkSet(names[id]));
+    }
+    remember(id, page_links);
+    return page_links;
+}
+
+
+/*
+ * Returns the links of page id if they're in memory, else null. Unlike links, it never
+ * reads the store file or fetches, and doesn't move the page up the recently-used list.
+ */
+shared_ptr<const vector<int>> LinkCache::cachedLinks(int id) const {
+    if (id >= int(entries.size())) return nullptr;
+    return entries[id].links;
+}
+
+
+/*
+ * Asks the prefetcher to fetch page id in the background, unless its links are already
+ * in memory or in the store file. Returns false only if the page still has to be
+ * fetched and can't be requested (no prefetcher, or its window is full).
+ */
+bool LinkCache::prefetch(int id, bool is_urgent) {
+    if (id < int(entries.size()) && (entries[id].links || entries[id].store_offset != -1)) {
+        return true;
+    }
+    return prefetcher != nullptr && prefetcher->request(names[id], is_urgent);
+}
+
+
+// adds the pages the prefetcher has finished fetching to the cache, making room in its window
+void LinkCache::collectPrefetched() {
+    if (prefetcher == nullptr) return;
+    for (auto& fetched : prefetcher->takeFinished()) {
+        int id = idOf(fetched.first);
+        if (id < int(entries.size()) && entries[id].links) continue;
+        addFetched(id, fetched.second);
+    }
+}
+
+
+// interns a page's freshly fetched links, saves them to the store file and keeps them in memory
+shared_ptr<const vector<int>> LinkCache::addFetched(int id, const unordered_set<string>& link_names) {
+    shared_ptr<const vector<int>> page_links = std::make_shared<const vector<int>>(intern(link_names));
+    ++num_fetched;
+    if (store.is_open()) {
+        std::ostringstream record;
+        record << names[id];
+        for (int link : *page_links) {
+            record << '\t' << names[link];
+        }
+        record << '\n';
+        store.seekp(store_end);
+        store << record.str();
+        store.flush();
+        if (store) {
+            if (id >= int(entries.size())) entries.resize(id + 1);
+            entries[id].store_offset = store_end;
+            store_end += record.str().size();
+        }
+        store.clear();
+    }
+    remember(id, page_links);
+    return page_links;
+}
+
+
+// reads the link set saved at offset in the store file (null if it can't be read)
+shared_ptr<const vector<int>> LinkCache::readFromStore(std::streamoff offset) {
+    store.clear();
+    store.seekg(offset);
+    string line;
+    if (!std::getline(store, line)) {
+        store.clear();
+        return nullptr;
+    }
+    unordered_set<string> link_names;
+    std::istringstream fields(line);
+    string field;
+    std::getline(fields, field, '\t');    // the page's own name
+    while (std::getline(fields, field, '\t')) {
+        link_names.insert(field);
+    }
+    return std::make_shared<const vector<int>>(intern(link_names));
+}
+
+
+// converts link names to sorted page IDs
+vector<int> LinkCache::intern(const unordered_set<string>& link_names) {
+    vector<int> link_ids;
+    link_ids.reserve(link_names.size());
+    for (const string& link : link_names) {
+        link_ids.push_back(idOf(link));
+    }
+    std::sort(link_ids.begin(), link_ids.end());
+    return link_ids;
+}
+
+
+// keeps a link set in memory as the most recently used one, dropping the least recent if full
+void LinkCache::remember(int id, shared_ptr<const vector<int>> page_links) {
+    if (id >= int(entries.size())) entries.resize(id + 1);
+    if (recently_used.size() == capacity) {
+        Entry& oldest = entries[recently_used.back()];
+        oldest.links.reset();
+        recently_used.pop_back();
+    }
+    recently_used.push_front(id);
+    entries[id].links = std::move(page_links);
+    entries[id].lru_position = recently_used.begin();
+}
+
+
+unordered_set<string> WikiScraperSource::getLinkSet(const string& page_name) {
+    thread_local WikiScraper scraper;
+    return scraper.getLinkSet(page_name);
+}
+
+
+DirectoryLinkSource::DirectoryLinkSource(const string& directory, std::chrono::milliseconds latency)
+    : directory(directory), latency(latency) {}
+
+
+unordered_set<string> DirectoryLinkSource::getLinkSet(const string& page_name) {
+    std::this_thread::sleep_for(latency);
+    string file_name;
+    for (char c : page_name) {
+        if (c == '/') {
+            file_name += "%2F";
+        } else {
+            file_name += c;
+        }
+    }
+    unordered_set<string> links;
+    std::ifstream page(directory + "/" + file_name);
+    string link;
+    while (std::getline(page, link)) {
+        if (!link.empty()) links.insert(link);
+    }
+    return links;
+}
+
+
+// starts the fetch workers
+LinkPrefetcher::LinkPrefetcher(LinkSource& source, int numWorkers, size_t maxInFlight)
+    : source(source), max_in_flight(std::max<size_t>(maxInFlight, 1)) {
+    for (int i = 0; i < std::max(numWorkers, 1); ++i) {
+        workers.emplace_back(&LinkPrefetcher::workerLoop, this);
+    }
+}
+
+
+// stops the workers once the fetches they're in the middle of are done
+LinkPrefetcher::~LinkPrefetcher() {
+    {
+        std::lock_guard<std::mutex> guard(lock);
+        is_stopping = true;
+    }
+    work_ready.notify_all();
+    for (std::thread& worker : workers) {
+        worker.join();
+    }
+}
+
+
+/*
+ * Queues a page to be fetched. Returns true if it is (or already was) requested, false if
+ * the window is full.
+ */
+bool LinkPrefetcher::request(const string& page_name, bool is_urgent) {
+    std::lock_guard<std::mutex> guard(lock);
+    if (fetches.count(page_name)) return true;
+    if (fetches.size() >= max_in_flight) return false;
+    fetches.emplace(page_name, Fetch());
+    if (is_urgent) {
+        urgent_queue.push_back(page_name);
+    } else {
+        speculative_queue.push_back(page_name);
+    }
+    work_ready.notify_one();
+    return true;
+}
+
+
+bool LinkPrefetcher::isRequested(const string& page_name) const {
+    std::lock_guard<std::mutex> guard(lock);
+    return fetches.count(page_name) != 0;
+}
+
+
+/*
+ * Returns the links of a requested page, waiting for the fetch if it isn't done yet (and
+ * moving it to the front of the queue if it hasn't started)
+ */
+unordered_set<string> LinkPrefetcher::wait(const string& page_name) {
+    std::unique_lock<std::mutex> guard(lock);
+    auto queued = std::find(speculative_queue.begin(), speculative_queue.end(), page_name);
+    if (queued != speculative_queue.end()) {
+        speculative_queue.erase(queued);
+        urgent_queue.push_front(page_name);
+    }
+    fetch_done.wait(guard, [&] { return fetches[page_name].is_done; });
+    unordered_set<string> links = std::move(fetches[page_name].links);
+    fetches.erase(page_name);
+    finished.erase(std::find(finished.begin(), finished.end(), page_name));
+    return links;
+}
+
+
+// returns every page whose fetch is done, with its links, and forgets them
+vector<std::pair<string, unordered_set<string>>> LinkPrefetcher::takeFinished() {
+    std::lock_guard<std::mutex> guard(lock);
+    vector<std::pair<string, unordered_set<string>>> done;
+    for (const string& page_name : finished) {
+        done.emplace_back(page_name, std::move(fetches[page_name].links));
+        fetches.erase(page_name);
+    }
+    finished.clear();
+    return done;
+}
+
+
+// fetches queued pages, urgent ones first, until the prefetcher is destroyed
+void LinkPrefetcher::workerLoop() {
+    std::unique_lock<std::mutex> guard(lock);
+    while (true) {
+        work_ready.wait(guard, [this] {
+            return is_stopping || !urgent_queue.empty() || !speculative_queue.empty();
+        });
+        if (is_stopping) return;
+        deque<string>& queue = urgent_queue.empty() ? speculative_queue : urgent_queue;
+        string page_name = queue.front();
+        queue.pop_front();
+
+        guard.unlock();
+        unordered_set<string> links = source.getLinkSet(page_name);
+        guard.lock();
+
+        fetches[page_name].links = std::move(links);
+        fetches[page_name].is_done = true;
+        finished.push_back(page_name);
+        fetch_done.notify_all();
+    }
+}
+
+
+/*
+ * Finds a ladder from start to end (Milkshake to Gene by default):
+ *     WikiLadder [--pages DIR] [--latency MS] [--workers N] [--window N] [--no-store] [START END]
+ * --pages reads pages from a directory (see DirectoryLinkSource) instead of Wikipedia,
+ * each fetch taking --latency milliseconds. --workers is the number of pages fetched at
+ * once (0 fetches one page at a time, without prefetching) and --window the number of
+ * fetches that can be requested ahead. Link sets are saved to kLinkStoreFile, or to
+ * kPagesStoreFile inside the --pages directory, unless --no-store is given.
+ */
+int main(int argc, char* argv[]) {
+    string pages_directory;
+    int latency_ms = 0;
+    int num_workers = kDefaultFetchWorkers;
+    int window = kDefaultFetchWindow;
+    bool use_store = true;
+    vector<string> ends;
+    bool is_valid = true;
+    for (int arg = 1; arg < argc && is_valid; ++arg) {
+        string name = argv[arg];
+        if (name.compare(0, 2, "--") != 0) {
+            ends.push_back(name);
+            continue;
+        }
+        if (name == "--no-store") {
+            use_store = false;
+            continue;
+        }
+        if (arg + 1 == argc) {
+            is_valid = false;
+            break;
+        }
+        std::istringstream value(argv[++arg]);
+        if (name == "--pages") {
+            pages_directory = value.str();
+        } else if (name == "--latency") {
+            is_valid = bool(value >> latency_ms);
+        } else if (name == "--workers") {
+            is_valid = bool(value >> num_workers);
+        } else if (name == "--window") {
+            is_valid = bool(value >> window);
+        } else {
+            is_valid = false;
+        }
+    }
+    if (ends.empty()) ends = {"Milkshake", "Gene"};
+    if (!is_valid || ends.size() != 2) {
+        cout << "Usage: " << argv[0]
+             << " [--pages DIR] [--latency MS] [--workers N] [--window N] [--no-store] [START END]"
+             << endl;
+        return 2;
+    }
+
+    // the store only ever holds link sets from one source
+    std::unique_ptr<LinkSource> source;
+    string store_file;
+    if (pages_directory.empty()) {
+        source.reset(new WikiScraperSource());
+        store_file = kLinkStoreFile;
+    } else {
+        source.reset(new DirectoryLinkSource(pages_directory, std::chrono::milliseconds(latency_ms)));
+        store_file = pages_directory + "/" + kPagesStoreFile;
+    }
+    if (!use_store) store_file.clear();
+    std::unique_ptr<LinkPrefetcher> prefetcher;
+    if (num_workers > 0) prefetcher.reset(new LinkPrefetcher(*source, num_workers, window));
+    LinkCache cache(*source, kDefaultCacheCapacity, store_file, prefetcher.get());
+
+    auto startTime = std::chrono::steady_clock::now();
+    auto ladder = findWikiLadder(ends[0], ends[1], cache);
+    std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - startTime;
+    cout << cache.numFetched() << " pages fetched in " << elapsed.count() << " s" << endl;
     if(ladder.empty()) {
         cout << "No ladder found!" << endl;
     } else {
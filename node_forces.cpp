@@ -6,52 +6,297 @@
 #include <vector>
 #include <cmath>
 #include <ctime>
+#include <chrono>
+#include <iomanip>
+#include <algorithm>
+#include <cctype>
+#include <charconv>
+#include <cstdint>
+#include <condition_variable>
+#include <cstring>
+#include <functional>
+#include <mutex>
+#include <thread>
+#ifdef __AVX2__
+#include <immintrin.h>
+#endif
+#ifndef _WIN32
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
 
 using std::cout;	  using std::endl;
 using std::string;    using std::cin;
 
+//graphs with more nodes than this use the Barnes-Hut approximation for repulsion by default
+const size_t kMaxExactNodes = 2000;
+//default Barnes-Hut opening angle: a cell is treated as one body once size/distance drops below it
+const double kOpeningAngle = 0.5;
+//quadtree cells stop splitting at this depth; nodes closer together than that share a leaf
+const int kMaxQuadDepth = 40;
+
+/* One square cell of the Barnes-Hut quadtree. A cell with no children is a leaf holding
+ * the node in body (or several nodes, if they were too close together to split at the
+ * maximum depth, in which case body is -1). mass is the number of nodes in the cell and
+ * (massX, massY) is their center of mass; the four children are stored consecutively.
+ */
+struct QuadCell {
+    double minX;
+    double minY;
+    double size;
+    double massX;
+    double massY;
+    int mass;
+    int body;
+    int firstChild;
+};
+
+/* Node positions as a structure of arrays (every x coordinate, then every y coordinate).
+ * This is the layout's working copy: the force kernels stream through x and y
+ * contiguously, four nodes at a time with AVX2, and the SimpleGraph itself is only
+ * updated when it is drawn.
+ */
+struct NodePositions {
+    std::vector<double> x;
+    std::vector<double> y;
+};
+
+/* Settings for a headless layout run (see layoutGraph). The run stops after maxIterations
+ * iterations, or earlier once the nodes moved less than tolerance in total (summed over all
+ * nodes) in one iteration; a tolerance of 0 always runs maxIterations. No node moves more
+ * than the temperature in one iteration, and the temperature is multiplied by cooling
+ * after every iteration, so the layout settles down instead of oscillating.
+ * If levelIterations is more than 0, the graph is laid out in several levels instead
+ * (see layoutMultilevel): maxIterations at the coarsest level, then levelIterations at
+ * each finer one.
+ * Repulsion is exact for graphs of up to kMaxExactNodes nodes and uses Barnes-Hut with
+ * opening angle theta for larger ones, unless repulsion asks for one or the other. theta
+ * = 0 never approximates; larger values are faster and less accurate (0.5 to 1 is usual).
+ */
+enum RepulsionMode { AUTO_REPULSION, EXACT_REPULSION, BARNES_HUT_REPULSION };
+
+struct LayoutOptions {
+    int maxIterations = 500;
+    double tolerance = 0.0;
+    double temperature = 0.1;
+    double cooling = 0.99;
+    int numThreads = 1;
+    int levelIterations = 0;
+    double theta = kOpeningAngle;
+    RepulsionMode repulsion = AUTO_REPULSION;
+};
+
+//multilevel layouts stop coarsening once a level has no more nodes than this
+const size_t kCoarsestNodes = 100;
+
+/* One level of a multilevel layout: a coarser copy of the graph below it, made by merging
+ * each node with a neighbor (or a few, around nodes whose neighbors were all taken).
+ * fineToCoarse maps every node of the finer graph to the node here that it was merged into.
+ */
+struct GraphLevel {
+    size_t numNodes;
+    std::vector<Edge> edges;
+    std::vector<int> fineToCoarse;
+};
+
+/* A file's contents, memory-mapped read-only (or read into memory where mmap is
+ * unavailable); data is null if the file can't be opened
+ */
+class MappedFile {
+public:
+    explicit MappedFile(const string& fileName);
+    ~MappedFile();
+    MappedFile(const MappedFile&) = delete;
+    MappedFile& operator=(const MappedFile&) = delete;
+
+    const char* data = nullptr;
+    size_t size = 0;
+
+private:
+    void* mapped = nullptr;
+    std::vector<char> owned;
+};
+
+/* Header of the binary edge-list format. It is followed by numEdges pairs of int32
+ * node indices (start, end), in the machine's byte order, so a mapped file can be read
+ * in place. Text graph files start with a digit, which tells the two formats apart.
+ */
+struct EdgeListHeader {
+    char magic[4];
+    int32_t numNodes;
+    int64_t numEdges;
+};
+const char kEdgeListMagic[4] = {'N','F','E','L'};
+
+/* Read-only view of a graph's edges: either a vector of Edge or the int32 (start, end)
+ * pairs of a mapped binary edge list, so a binary graph can be laid out straight from its
+ * mapping without widening every index to size_t first. It owns nothing; whatever it
+ * views has to outlive it
+ */
+class EdgeSpan {
+public:
+    EdgeSpan() {}
+    EdgeSpan(const std::vector<Edge>& myEdges) : edges(myEdges.data()), numEdges(myEdges.size()) {}
+    EdgeSpan(const int32_t* ends,size_t numEdges) : ends(ends), numEdges(numEdges) {}
+
+    size_t size() const { return numEdges; }
+    size_t start(size_t e) const { return edges != nullptr ? edges[e].start : size_t(ends[2*e]); }
+    size_t end(size_t e) const { return edges != nullptr ? edges[e].end : size_t(ends[2*e+1]); }
+    Edge operator[](size_t e) const {
+        Edge myEdge;
+        myEdge.start = start(e);
+        myEdge.end = end(e);
+        return myEdge;
+    }
+
+private:
+    const Edge* edges = nullptr;
+    const int32_t* ends = nullptr;
+    size_t numEdges = 0;
+};
+
+/* Changes to a graph that has already been laid out (see updateLayout). Node indices
+ * refer to the graph before the change, with the added nodes numbered after the existing
+ * ones; after the change the remaining nodes are renumbered in order, closing the gaps
+ * left by removed nodes. Removing an edge removes every copy of it, in either direction.
+ */
+struct GraphDelta {
+    int numAddedNodes = 0;
+    std::vector<Edge> addedEdges;
+    std::vector<Edge> removedEdges;
+    std::vector<size_t> removedNodes;
+};
+
+/* A graph and its layout, kept between incremental updates (see updateLayout) so that an
+ * update only has to touch the nodes near its changes. incidentEdges lists the indices in
+ * edges of every node's edges (a self-loop twice). Removed edges stay in edges, flagged in
+ * isEdgeRemoved, until compactEdges drops them. cells is a Barnes-Hut quadtree over every
+ * node; updates patch it as nodes move, and rebuild it once more nodes have been patched
+ * than the graph has. hops is scratch space for updates and is -1 everywhere between them.
+ */
+struct LayoutState {
+    NodePositions positions;
+    std::vector<Edge> edges;
+    std::vector<char> isEdgeRemoved;
+    size_t numRemovedEdges = 0;
+    std::vector<std::vector<size_t>> incidentEdges;
+    std::vector<QuadCell> cells;
+    size_t numPatched = 0;
+    std::vector<int> hops;
+};
+
+/* Threads for calculateForces, started once and kept for a whole layout instead of being
+ * started and joined every iteration. run hands the same task to every thread and waits
+ * for all of them; the calling thread takes part 0 itself. accX and accY are each thread's
+ * accumulator for the exact repulsion and edge passes, kept between iterations (and left
+ * zeroed after each).
+ */
+class ForceWorkers {
+public:
+    explicit ForceWorkers(int numThreads);
+    ~ForceWorkers();
+    ForceWorkers(const ForceWorkers&) = delete;
+    ForceWorkers& operator=(const ForceWorkers&) = delete;
+
+    int numThreads() const { return helpers.size() + 1; }
+    void run(const std::function<void(int)>& task);
+
+    std::vector<std::vector<double>> accX;
+    std::vector<std::vector<double>> accY;
+
+private:
+    void work(int part);
+
+    std::vector<std::thread> helpers;
+    std::mutex lock;
+    std::condition_variable wake;
+    std::condition_variable finished;
+    const std::function<void(int)>* task = nullptr;
+    long long generation = 0;
+    int numRunning = 0;
+    bool isStopping = false;
+};
+
 //function prototypes
+int runBatch(int argc,char* argv[]);
+int layoutGraph(const EdgeSpan& myEdges,NodePositions& positions,const LayoutOptions& options,double* lastDisplacement = nullptr);
+int layoutMultilevel(const EdgeSpan& myEdges,NodePositions& positions,const LayoutOptions& options,double* lastDisplacement = nullptr);
+LayoutState makeLayoutState(const EdgeSpan& myEdges,const NodePositions& positions);
+int updateLayout(LayoutState& state,const GraphDelta& delta,const LayoutOptions& options,int numHops,double* lastDisplacement = nullptr);
+int relaxRegion(LayoutState& state,const std::vector<int>& active,const LayoutOptions& options,double* lastDisplacement);
+void dropEdge(LayoutState& state,size_t edge);
+void compactEdges(LayoutState& state);
+bool readLayout(const string& fileName,NodePositions& positions);
+bool readGraphDelta(const string& fileName,GraphDelta& delta);
+GraphLevel coarsenGraph(size_t numNodes,const EdgeSpan& myEdges);
+void buildAdjacency(size_t numNodes,const EdgeSpan& myEdges,std::vector<size_t>& firstNeighbor,std::vector<int>& neighbors);
+NodePositions interpolatePositions(const NodePositions& coarsePositions,const GraphLevel& level,size_t numFineNodes);
+int convertGraph(const string& inputName,const string& outputName);
+bool loadGraph(const string& fileName,SimpleGraph& myGraph);
+bool loadMappedGraph(const MappedFile& input,SimpleGraph& myGraph,EdgeSpan& myEdges);
+bool isBinaryGraph(const MappedFile& input);
+bool parseTextGraph(const char* text,size_t size,SimpleGraph& myGraph);
+bool parseBinaryGraph(const char* image,size_t size,SimpleGraph& myGraph,EdgeSpan& myEdges);
+bool isValidEdge(const Edge& myEdge,size_t numNodes,size_t edgeIndex);
+bool writeTextGraph(const string& fileName,size_t numNodes,const EdgeSpan& myEdges);
+bool writeBinaryGraph(const string& fileName,size_t numNodes,const EdgeSpan& myEdges);
+bool writeLayout(const string& fileName,const NodePositions& positions);
 void Welcome();
 void readGraph();
-std::ifstream streamCreator();
+SimpleGraph graphCreator();
 int getInteger();
 string GetLine();
 std::vector<Node> nodeCreator(const int numNodes);
-std::vector<Edge> edgeCreator(std::ifstream& myStream);
-void calculateRepulsiveForces(const SimpleGraph& myGraph,std::vector<double>& nodePosX,std::vector<double>& nodePosY);
-void calculateAttractiveForces(const SimpleGraph& myGraph,std::vector<double>& nodePosX,std::vector<double>& nodePosY);
-void moveNodes(SimpleGraph& myGraph,std::vector<double>& nodePosX,std::vector<double>& nodePosY);
+NodePositions positionsOf(const SimpleGraph& myGraph);
+void storePositions(const NodePositions& positions,SimpleGraph& myGraph);
+void calculateForces(const EdgeSpan& myEdges,const NodePositions& positions,std::vector<double>& nodeDelX,std::vector<double>& nodeDelY,const LayoutOptions& options,ForceWorkers& workers);
+bool usesBarnesHut(const LayoutOptions& options,size_t numNodes);
+void repelRows(const NodePositions& positions,std::vector<double>& nodeDelX,std::vector<double>& nodeDelY,size_t firstRow,size_t lastRow);
+size_t pairSplitRow(size_t numNodes,int part,int numParts);
+void repelRowsBarnesHut(const std::vector<QuadCell>& cells,const NodePositions& positions,std::vector<double>& nodeDelX,std::vector<double>& nodeDelY,double theta,size_t firstRow,size_t lastRow);
+void repelFromQuadtree(const std::vector<QuadCell>& cells,double x,double y,int self,double theta,double& delX,double& delY,std::vector<int>& pending);
+std::vector<QuadCell> buildQuadtree(const NodePositions& positions);
+void fillQuadCell(std::vector<QuadCell>& cells,int cell,const NodePositions& positions,std::vector<int>& bodies,size_t first,size_t last,int depth);
+int quadrantOf(const QuadCell& cell,double x,double y);
+void removeFromQuadtree(std::vector<QuadCell>& cells,const NodePositions& positions,int node);
+bool insertIntoQuadtree(std::vector<QuadCell>& cells,const NodePositions& positions,int node);
+void attractEdges(const EdgeSpan& myEdges,const NodePositions& positions,std::vector<double>& nodeDelX,std::vector<double>& nodeDelY,size_t firstEdge,size_t lastEdge);
+double moveNodes(NodePositions& positions,const std::vector<double>& nodeDelX,const std::vector<double>& nodeDelY,double maxStep = HUGE_VAL);
+
+/* main method. With arguments it lays out one graph without drawing it (see runBatch),
+ * otherwise it prompts for graphs and animates their layout
+ */
+int main(int argc,char* argv[]) {
 
-//main method
-int main() {
+    if (argc > 1) return runBatch(argc,argv);
 
     Welcome();
 
     //will re-prompt forever
     while (true) {
 
-        //prompts user for file name and opens it
+        //prompts user for file name and loads the graph
         cout << "Please enter a file name\n> ";
-        std::ifstream myStream = streamCreator();
+        SimpleGraph myGraph = graphCreator();
 
         cout << "Great! Now, please enter the number of seconds you'd like to iterate for\n> ";
         int numTotalSeconds = getInteger();
 
-        //initialize graph
-        SimpleGraph myGraph;
-
-        //create nodes
-        int kNumNodes;
-        myStream >> kNumNodes;
-        std::vector<Node> myNodes = nodeCreator(kNumNodes);
-        myGraph.nodes = myNodes;
-
-        //create edges
-        std::vector<Edge> myEdges = edgeCreator(myStream);
-        myGraph.edges = myEdges;
+        cout << "How many threads should the layout use? (0 for one per core)\n> ";
+        int numThreads = getInteger();
+        if (numThreads <= 0) numThreads = std::max(1u,std::thread::hardware_concurrency());
 
         InitGraphVisualizer(myGraph);
         DrawGraph(myGraph);
+        NodePositions positions = positionsOf(myGraph);
+        LayoutOptions options;
+        ForceWorkers workers(numThreads);
+
+        //vectors of node position changes
+        std::vector<double> nodeDelX(myGraph.nodes.size());
+        std::vector<double> nodeDelY(myGraph.nodes.size());
 
         //begin timer
         time_t startTime = time(NULL);
@@ -59,20 +304,16 @@ int main() {
 
         while(elapsedTime < double(numTotalSeconds)) {
 
-            //make vectors of node position changes
-            std::vector<double> nodeDelX(kNumNodes,0.0);
-            std::vector<double> nodeDelY(kNumNodes,0.0);
-
-            //calculate repulsive forces
-            calculateRepulsiveForces(myGraph,nodeDelX,nodeDelY);
-
-            //calculate attractive forces
-            calculateAttractiveForces(myGraph,nodeDelX,nodeDelY);
+            //calculate repulsive and attractive forces
+            std::fill(nodeDelX.begin(),nodeDelX.end(),0.0);
+            std::fill(nodeDelY.begin(),nodeDelY.end(),0.0);
+            calculateForces(myGraph.edges,positions,nodeDelX,nodeDelY,options,workers);
 
             //node movement
-            moveNodes(myGraph,nodeDelX,nodeDelY);
+            moveNodes(positions,nodeDelX,nodeDelY);
 
             //update graph
+            storePositions(positions,myGraph);
             DrawGraph(myGraph);
 
             //update time
@@ -86,6 +327,932 @@ int main() {
 }
 
 
+/* Headless batch mode, for laying out graphs in a pipeline:
+ *     node_forces INPUT OUTPUT [--iterations N] [--tolerance X] [--temperature X]
+ *                              [--cooling X] [--threads N] [--multilevel N] [--theta X]
+ *                              [--exact | --barnes-hut]
+ * reads a graph in the usual format from INPUT, lays it out without rendering anything and
+ * writes the final coordinates to OUTPUT (the number of nodes, then "x y" for every node).
+ * The options are the fields of LayoutOptions; --threads 0 uses one thread per core,
+ * --multilevel N lays the graph out in levels with N iterations at each finer level, and
+ * --exact or --barnes-hut computes repulsion that way whatever the size of the graph.
+ *     node_forces INPUT OUTPUT --layout OLD --delta CHANGES [--hops N] [--graph-out FILE] ...
+ * instead updates OLD, a layout of INPUT written by an earlier run, for the changes listed in
+ * CHANGES (see readGraphDelta), moving only the nodes within N hops (default 2) of a change
+ * (see updateLayout). --delta may be given several times; the changes are applied in turn,
+ * each to the graph left by the one before. --graph-out writes the changed graph, ready for
+ * the next update.
+ * Prints how long the layout took and returns 0, or 1 if a file can't be read or written
+ * and 2 for bad arguments.
+ *     node_forces --convert INPUT OUTPUT
+ * converts a text graph file to the binary edge-list format, or a binary one back to text.
+ */
+int runBatch(int argc,char* argv[]) {
+    if (argc == 4 && string(argv[1]) == "--convert") return convertGraph(argv[2],argv[3]);
+
+    LayoutOptions options;
+    std::vector<string> paths;
+    string layoutName, graphOutName;
+    std::vector<string> deltaNames;
+    int numHops = 2;
+    bool isValid = true;
+    for (int arg = 1; arg < argc && isValid; ++arg) {
+        string name = argv[arg];
+        if (name.compare(0,2,"--") != 0) {
+            paths.push_back(name);
+            continue;
+        }
+        if (name == "--exact" || name == "--barnes-hut") {
+            options.repulsion = name == "--exact" ? EXACT_REPULSION : BARNES_HUT_REPULSION;
+            continue;
+        }
+        if (arg+1 == argc) {
+            isValid = false;
+            break;
+        }
+        std::istringstream value(argv[++arg]);
+        if (name == "--iterations") {
+            isValid = bool(value >> options.maxIterations);
+        } else if (name == "--tolerance") {
+            isValid = bool(value >> options.tolerance);
+        } else if (name == "--temperature") {
+            isValid = bool(value >> options.temperature);
+        } else if (name == "--cooling") {
+            isValid = bool(value >> options.cooling);
+        } else if (name == "--threads") {
+            isValid = bool(value >> options.numThreads);
+        } else if (name == "--multilevel") {
+            isValid = bool(value >> options.levelIterations);
+        } else if (name == "--theta") {
+            isValid = bool(value >> options.theta);
+        } else if (name == "--hops") {
+            isValid = bool(value >> numHops);
+        } else if (name == "--layout") {
+            isValid = bool(value >> layoutName);
+        } else if (name == "--delta") {
+            deltaNames.emplace_back();
+            isValid = bool(value >> deltaNames.back());
+        } else if (name == "--graph-out") {
+            isValid = bool(value >> graphOutName);
+        } else {
+            isValid = false;
+        }
+
+        //and nothing may follow the value ("5x" is not a number)
+        char remaining;
+        if (isValid && value >> remaining) isValid = false;
+    }
+    if (!isValid || paths.size() != 2 || options.maxIterations < 0 || options.levelIterations < 0
+            || options.theta < 0 || numHops < 0 || layoutName.empty() != deltaNames.empty()) {
+        std::cerr << "Usage: " << argv[0] << " INPUT OUTPUT [--iterations N] [--tolerance X]"
+                  << " [--temperature X] [--cooling X] [--threads N] [--multilevel N]"
+                  << " [--theta X] [--exact | --barnes-hut]"
+                  << " [--layout OLD --delta CHANGES [--hops N] [--graph-out FILE]]" << endl;
+        return 2;
+    }
+    if (options.numThreads <= 0) options.numThreads = std::max(1u,std::thread::hardware_concurrency());
+
+    //a binary graph's edges are read straight out of the mapping, so it stays open throughout
+    MappedFile input(paths[0]);
+    SimpleGraph myGraph;
+    EdgeSpan myEdges;
+    if (input.data == nullptr || !loadMappedGraph(input,myGraph,myEdges)) {
+        std::cerr << "Couldn't read the graph in " << paths[0] << endl;
+        return 1;
+    }
+    NodePositions positions = positionsOf(myGraph);
+    std::vector<GraphDelta> deltas(deltaNames.size());
+    if (!layoutName.empty()) {
+        if (!readLayout(layoutName,positions) || positions.x.size() != myGraph.nodes.size()) {
+            std::cerr << "Couldn't read a layout of " << paths[0] << " from " << layoutName << endl;
+            return 1;
+        }
+        for (size_t d = 0; d < deltas.size(); ++d) {
+            if (!readGraphDelta(deltaNames[d],deltas[d])) {
+                std::cerr << "Couldn't read the changes in " << deltaNames[d] << endl;
+                return 1;
+            }
+        }
+    }
+
+    auto startTime = std::chrono::steady_clock::now();
+    double lastDisplacement = 0.0;
+    int numIterations;
+    if (!layoutName.empty()) {
+        LayoutState state = makeLayoutState(myEdges,positions);
+        numIterations = 0;
+        for (size_t d = 0; d < deltas.size(); ++d) {
+            int numUpdateIterations = updateLayout(state,deltas[d],options,numHops,&lastDisplacement);
+            if (numUpdateIterations < 0) {
+                std::cerr << "The changes in " << deltaNames[d] << " refer to nodes that don't exist" << endl;
+                return 1;
+            }
+            numIterations += numUpdateIterations;
+        }
+        compactEdges(state);
+        myGraph.edges = std::move(state.edges);
+        myEdges = myGraph.edges;
+        positions = std::move(state.positions);
+    } else if (options.levelIterations > 0) {
+        numIterations = layoutMultilevel(myEdges,positions,options,&lastDisplacement);
+    } else {
+        numIterations = layoutGraph(myEdges,positions,options,&lastDisplacement);
+    }
+    std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - startTime;
+    myGraph.nodes.resize(positions.x.size());
+
+    if (!writeLayout(paths[1],positions)) {
+        std::cerr << "Couldn't write the layout to " << paths[1] << endl;
+        return 1;
+    }
+    if (!graphOutName.empty() && !writeTextGraph(graphOutName,myGraph.nodes.size(),myEdges)) {
+        std::cerr << "Couldn't write the graph to " << graphOutName << endl;
+        return 1;
+    }
+    cout << myGraph.nodes.size() << " nodes, " << myEdges.size() << " edges: "
+         << numIterations << " iterations in " << elapsed.count() << " s ("
+         << (elapsed.count() > 0 ? numIterations / elapsed.count() : 0.0) << " iterations/s), "
+         << "final displacement " << lastDisplacement << endl;
+    return 0;
+}
+
+
+/* Runs the layout on positions as described for LayoutOptions and returns the number of
+ * iterations it took. If lastDisplacement isn't null, it gets the total distance the nodes
+ * moved in the last iteration
+ */
+int layoutGraph(const EdgeSpan& myEdges,NodePositions& positions,const LayoutOptions& options,double* lastDisplacement) {
+    const size_t numNodes = positions.x.size();
+    std::vector<double> nodeDelX(numNodes);
+    std::vector<double> nodeDelY(numNodes);
+    ForceWorkers workers(options.numThreads);
+    double temperature = options.temperature;
+    double displacement = 0.0;
+    int iteration = 0;
+    while (iteration < options.maxIterations) {
+        std::fill(nodeDelX.begin(),nodeDelX.end(),0.0);
+        std::fill(nodeDelY.begin(),nodeDelY.end(),0.0);
+        calculateForces(myEdges,positions,nodeDelX,nodeDelY,options,workers);
+        displacement = moveNodes(positions,nodeDelX,nodeDelY,temperature);
+        temperature *= options.cooling;
+        ++iteration;
+        if (displacement < options.tolerance) break;
+    }
+    if (lastDisplacement != nullptr) *lastDisplacement = displacement;
+    return iteration;
+}
+
+
+/* Multilevel layout for large graphs. The graph is coarsened (see coarsenGraph) until it
+ * has at most kCoarsestNodes nodes or stops shrinking; the coarsest level is laid out from
+ * the circle with options.maxIterations iterations, and then each finer level starts from
+ * the level above it (see interpolatePositions) and is refined with options.levelIterations
+ * iterations. Returns the iterations run over all levels; positions only supplies the
+ * number of nodes and gets the final layout
+ */
+int layoutMultilevel(const EdgeSpan& myEdges,NodePositions& positions,const LayoutOptions& options,double* lastDisplacement) {
+    std::vector<GraphLevel> levels;
+    size_t numNodes = positions.x.size();
+    EdgeSpan edges = myEdges;
+    while (numNodes > kCoarsestNodes) {
+        GraphLevel level = coarsenGraph(numNodes,edges);
+        if (level.numNodes > numNodes - numNodes/10) break;    //less than 10% smaller
+        levels.push_back(std::move(level));
+        numNodes = levels.back().numNodes;
+        edges = levels.back().edges;
+    }
+
+    //the coarsest level starts from the circle; the others from the level above
+    NodePositions levelPositions;
+    for (const Node& myNode : nodeCreator(numNodes)) {
+        levelPositions.x.push_back(myNode.x);
+        levelPositions.y.push_back(myNode.y);
+    }
+    int numIterations = layoutGraph(edges,levelPositions,options,lastDisplacement);
+
+    LayoutOptions refine = options;
+    refine.maxIterations = options.levelIterations;
+    for (size_t level = levels.size(); level-- > 0; ) {
+        size_t numFineNodes = level == 0 ? positions.x.size() : levels[level-1].numNodes;
+        EdgeSpan fineEdges = level == 0 ? myEdges : EdgeSpan(levels[level-1].edges);
+        levelPositions = interpolatePositions(levelPositions,levels[level],numFineNodes);
+        numIterations += layoutGraph(fineEdges,levelPositions,refine,lastDisplacement);
+    }
+    positions = std::move(levelPositions);
+    return numIterations;
+}
+
+
+/* Sets up a graph and its layout for incremental updates: its lists of edges per node and
+ * the quadtree over all of its nodes. This is the only step of an update that is linear in
+ * the size of the graph
+ */
+LayoutState makeLayoutState(const EdgeSpan& myEdges,const NodePositions& positions) {
+    LayoutState state;
+    state.positions = positions;
+    state.edges.resize(myEdges.size());
+    for (size_t e = 0; e < myEdges.size(); ++e) {
+        state.edges[e] = myEdges[e];
+    }
+    state.isEdgeRemoved.assign(myEdges.size(),false);
+    compactEdges(state);
+    state.cells = buildQuadtree(state.positions);
+    state.hops.assign(positions.x.size(),-1);
+    return state;
+}
+
+
+/* Updates a layout after a small change to the graph instead of laying it out again.
+ * state holds the graph and its layout before the change (see makeLayoutState), and is
+ * updated in place. Each added node starts next to the average position of its placed
+ * neighbors (nodes with none start next to the center of the old layout). Only the nodes
+ * within numHops hops of a change then move: the added nodes, the ends of added and
+ * removed edges and the neighbors of removed nodes. Everything else stays where it is but
+ * still pushes and pulls on them. The moving nodes get up to options.maxIterations
+ * iterations, stopping early once they move less than options.tolerance in total.
+ * Only the changed nodes' edges and the quadtree cells above the moving nodes are
+ * touched, except that removing nodes renumbers the rest and so rebuilds the whole state.
+ * Returns the number of iterations, or -1 (changing nothing) if delta refers to a node
+ * that doesn't exist
+ */
+int updateLayout(LayoutState& state,const GraphDelta& delta,const LayoutOptions& options,int numHops,double* lastDisplacement) {
+    const double kGoldenAngle = 2.39996322972865332;
+    const double kSpread = 0.1;
+    const int kRemoved = -2;
+    NodePositions& positions = state.positions;
+    std::vector<int>& hops = state.hops;
+    const size_t numOld = positions.x.size();
+    const size_t numAll = numOld + std::max(0,delta.numAddedNodes);
+    for (const std::vector<Edge>* edges : {&delta.addedEdges,&delta.removedEdges}) {
+        for (const Edge& myEdge : *edges) {
+            if (myEdge.start >= numAll || myEdge.end >= numAll) return -1;
+        }
+    }
+    for (size_t node : delta.removedNodes) {
+        if (node >= numAll) return -1;
+    }
+
+    //hops is kRemoved for removed nodes and the distance from a change for nodes that move
+    positions.x.resize(numAll,0.0);
+    positions.y.resize(numAll,0.0);
+    state.incidentEdges.resize(numAll);
+    hops.resize(numAll,-1);
+    std::vector<size_t> removedNodes;
+    for (size_t node : delta.removedNodes) {
+        if (hops[node] == kRemoved) continue;
+        hops[node] = kRemoved;
+        removedNodes.push_back(node);
+    }
+    std::vector<int> active;
+    auto seed = [&](size_t node) {
+        if (hops[node] != -1) return;
+        hops[node] = 0;
+        active.push_back(node);
+    };
+
+    //the changed graph, still numbered as before the change
+    for (size_t node : removedNodes) {
+        if (node < numOld) removeFromQuadtree(state.cells,positions,node);
+        std::vector<size_t> cut = state.incidentEdges[node];
+        for (size_t e : cut) {
+            seed(state.edges[e].start);
+            seed(state.edges[e].end);
+            dropEdge(state,e);
+        }
+    }
+    for (const Edge& myEdge : delta.removedEdges) {
+        seed(myEdge.start);
+        seed(myEdge.end);
+        std::vector<size_t> cut;
+        for (size_t e : state.incidentEdges[myEdge.start]) {
+            const Edge& other = state.edges[e];
+            if ((other.start == myEdge.start && other.end == myEdge.end)
+                    || (other.start == myEdge.end && other.end == myEdge.start)) cut.push_back(e);
+        }
+        for (size_t e : cut) {
+            dropEdge(state,e);
+        }
+    }
+    for (const Edge& myEdge : delta.addedEdges) {
+        if (hops[myEdge.start] == kRemoved || hops[myEdge.end] == kRemoved) continue;
+        state.incidentEdges[myEdge.start].push_back(state.edges.size());
+        state.incidentEdges[myEdge.end].push_back(state.edges.size());
+        state.edges.push_back(myEdge);
+        state.isEdgeRemoved.push_back(false);
+        seed(myEdge.start);
+        seed(myEdge.end);
+    }
+    for (size_t node = numOld; node < numAll; ++node) {
+        seed(node);
+    }
+    auto neighborOf = [&](size_t node,size_t e) {
+        return state.edges[e].start == node ? state.edges[e].end : state.edges[e].start;
+    };
+
+    //place the added nodes, in rounds, so chains of new nodes grow out from the old ones
+    std::vector<char> isAddedPlaced(numAll - numOld,false);
+    auto isPlaced = [&](size_t node) { return node < numOld || isAddedPlaced[node - numOld]; };
+    std::vector<size_t> unplaced;
+    for (size_t node = numOld; node < numAll; ++node) {
+        if (hops[node] != kRemoved) unplaced.push_back(node);
+    }
+    int numPlaced = 0;
+    auto place = [&](size_t node,double x,double y) {
+        positions.x[node] = x + kSpread * cos(kGoldenAngle * numPlaced);
+        positions.y[node] = y + kSpread * sin(kGoldenAngle * numPlaced);
+        ++numPlaced;
+    };
+    while (!unplaced.empty()) {
+        std::vector<size_t> stillUnplaced;
+        std::vector<size_t> placedNow;
+        for (size_t node : unplaced) {
+            double sumX = 0.0, sumY = 0.0;
+            int count = 0;
+            for (size_t e : state.incidentEdges[node]) {
+                size_t neighbor = neighborOf(node,e);
+                if (!isPlaced(neighbor)) continue;
+                sumX += positions.x[neighbor];
+                sumY += positions.y[neighbor];
+                ++count;
+            }
+            if (count == 0) {
+                stillUnplaced.push_back(node);
+            } else {
+                place(node,sumX/count,sumY/count);
+                placedNow.push_back(node);
+            }
+        }
+        for (size_t node : placedNow) {
+            isAddedPlaced[node - numOld] = true;
+        }
+        if (placedNow.empty()) {
+            //nothing placed next to them: start from the center of mass of the old layout
+            bool hasCenter = !state.cells.empty() && state.cells[0].mass > 0;
+            for (size_t node : stillUnplaced) {
+                place(node,hasCenter ? state.cells[0].massX : 0.0,hasCenter ? state.cells[0].massY : 0.0);
+            }
+            break;
+        }
+        unplaced = std::move(stillUnplaced);
+    }
+
+    //the nodes that move: everything within numHops hops of a change
+    std::sort(active.begin(),active.end());
+    for (size_t next = 0; next < active.size(); ++next) {
+        int node = active[next];
+        if (hops[node] == numHops) continue;
+        for (size_t e : state.incidentEdges[node]) {
+            size_t neighbor = neighborOf(node,e);
+            if (hops[neighbor] != -1) continue;
+            hops[neighbor] = hops[node] + 1;
+            active.push_back(neighbor);
+        }
+    }
+
+    //the rest stay in the quadtree, which holds them still while the active nodes move
+    for (int node : active) {
+        if (size_t(node) < numOld) removeFromQuadtree(state.cells,positions,node);
+    }
+    int numIterations = relaxRegion(state,active,options,lastDisplacement);
+    bool isTreeValid = true;
+    for (int node : active) {
+        if (!insertIntoQuadtree(state.cells,positions,node)) isTreeValid = false;
+    }
+    state.numPatched += active.size();
+
+    if (removedNodes.empty()) {
+        for (int node : active) {
+            hops[node] = -1;
+        }
+    } else {
+        //close the gaps left by removed nodes, which renumbers everything after them
+        std::vector<size_t> newIndex(numAll);
+        size_t numKept = 0;
+        for (size_t node = 0; node < numAll; ++node) {
+            newIndex[node] = numKept;
+            if (hops[node] == kRemoved) continue;
+            positions.x[numKept] = positions.x[node];
+            positions.y[numKept] = positions.y[node];
+            ++numKept;
+        }
+        positions.x.resize(numKept);
+        positions.y.resize(numKept);
+        for (Edge& myEdge : state.edges) {
+            myEdge.start = newIndex[myEdge.start];
+            myEdge.end = newIndex[myEdge.end];
+        }
+        compactEdges(state);
+        hops.assign(numKept,-1);
+        isTreeValid = false;
+    }
+    if (state.numRemovedEdges > state.edges.size()/2) compactEdges(state);
+    if (!isTreeValid || state.numPatched > positions.x.size()) {
+        state.cells = buildQuadtree(positions);
+        state.numPatched = 0;
+    }
+    return numIterations;
+}
+
+
+/* Runs the layout on the active nodes only, with every other node held in place. Those
+ * repel through state.cells, which must not hold the active nodes while this runs; the
+ * active nodes repel each other exactly (or through their own quadtree, rebuilt every
+ * iteration, when there are many of them), and each is pulled along its own edges.
+ * Returns the number of iterations, as for layoutGraph
+ */
+int relaxRegion(LayoutState& state,const std::vector<int>& active,const LayoutOptions& options,double* lastDisplacement) {
+    const double k_attract = 0.001;
+    NodePositions& positions = state.positions;
+    NodePositions activePositions;
+    activePositions.x.resize(active.size());
+    activePositions.y.resize(active.size());
+    std::vector<double> nodeDelX(active.size());
+    std::vector<double> nodeDelY(active.size());
+    std::vector<int> pending;
+    const bool approximate = usesBarnesHut(options,active.size());
+    const double frozenTheta = options.repulsion == EXACT_REPULSION ? 0.0 : options.theta;
+    double temperature = options.temperature;
+    double displacement = 0.0;
+    int iteration = 0;
+    while (iteration < options.maxIterations && !active.empty()) {
+        for (size_t a = 0; a < active.size(); ++a) {
+            activePositions.x[a] = positions.x[active[a]];
+            activePositions.y[a] = positions.y[active[a]];
+        }
+        std::fill(nodeDelX.begin(),nodeDelX.end(),0.0);
+        std::fill(nodeDelY.begin(),nodeDelY.end(),0.0);
+
+        //repulsion from the frozen nodes, then among the active ones
+        for (size_t a = 0; a < active.size(); ++a) {
+            repelFromQuadtree(state.cells,activePositions.x[a],activePositions.y[a],-1,frozenTheta,nodeDelX[a],nodeDelY[a],pending);
+        }
+        if (approximate) {
+            std::vector<QuadCell> activeCells = buildQuadtree(activePositions);
+            repelRowsBarnesHut(activeCells,activePositions,nodeDelX,nodeDelY,options.theta,0,active.size());
+        } else {
+            repelRows(activePositions,nodeDelX,nodeDelY,0,active.size());
+        }
+
+        //attraction, as in attractEdges, on each active node along its own edges
+        for (size_t a = 0; a < active.size(); ++a) {
+            size_t node = active[a];
+            for (size_t e : state.incidentEdges[node]) {
+                const Edge& myEdge = state.edges[e];
+                size_t neighbor = myEdge.start == node ? myEdge.end : myEdge.start;
+                double dx = positions.x[neighbor] - activePositions.x[a];
+                double dy = positions.y[neighbor] - activePositions.y[a];
+                double scale = k_attract * sqrt(dx*dx + dy*dy);
+                nodeDelX[a] += scale * dx;
+                nodeDelY[a] += scale * dy;
+            }
+        }
+
+        displacement = moveNodes(activePositions,nodeDelX,nodeDelY,temperature);
+        for (size_t a = 0; a < active.size(); ++a) {
+            positions.x[active[a]] = activePositions.x[a];
+            positions.y[active[a]] = activePositions.y[a];
+        }
+        temperature *= options.cooling;
+        ++iteration;
+        if (displacement < options.tolerance) break;
+    }
+    if (lastDisplacement != nullptr) *lastDisplacement = displacement;
+    return iteration;
+}
+
+
+//Flags an edge as removed and takes it off its ends' lists of edges
+void dropEdge(LayoutState& state,size_t edge) {
+    if (state.isEdgeRemoved[edge]) return;
+    state.isEdgeRemoved[edge] = true;
+    ++state.numRemovedEdges;
+    for (size_t node : {state.edges[edge].start,state.edges[edge].end}) {
+        std::vector<size_t>& incident = state.incidentEdges[node];
+        incident.erase(std::remove(incident.begin(),incident.end(),edge),incident.end());
+    }
+}
+
+
+/* Drops the removed edges from state.edges, keeping the rest in order, and rebuilds every
+ * node's list of edges to match
+ */
+void compactEdges(LayoutState& state) {
+    size_t numKept = 0;
+    for (size_t e = 0; e < state.edges.size(); ++e) {
+        if (!state.isEdgeRemoved[e]) state.edges[numKept++] = state.edges[e];
+    }
+    state.edges.resize(numKept);
+    state.isEdgeRemoved.assign(numKept,false);
+    state.numRemovedEdges = 0;
+    state.incidentEdges.assign(state.positions.x.size(),std::vector<size_t>());
+    for (size_t e = 0; e < numKept; ++e) {
+        state.incidentEdges[state.edges[e].start].push_back(e);
+        state.incidentEdges[state.edges[e].end].push_back(e);
+    }
+}
+
+
+//Reads a layout written by writeLayout; false if the file can't be read or is malformed
+bool readLayout(const string& fileName,NodePositions& positions) {
+    std::ifstream myStream(fileName);
+    size_t numNodes;
+    if (!(myStream >> numNodes)) return false;
+    NodePositions loaded;
+    loaded.x.resize(numNodes);
+    loaded.y.resize(numNodes);
+    for (size_t i = 0; i < numNodes; ++i) {
+        if (!(myStream >> loaded.x[i] >> loaded.y[i])) return false;
+    }
+    positions = std::move(loaded);
+    return true;
+}
+
+
+/* Reads a list of changes to a graph, one per line:
+ *     node          adds a node
+ *     edge a b      adds an edge between nodes a and b
+ *     -edge a b     removes the edge between a and b
+ *     -node a       removes node a and its edges
+ * Returns false if the file can't be opened or a line isn't one of these
+ */
+bool readGraphDelta(const string& fileName,GraphDelta& delta) {
+    std::ifstream myStream(fileName);
+    if (!myStream) return false;
+    string change;
+    while (myStream >> change) {
+        Edge myEdge;
+        size_t node;
+        if (change == "node") {
+            ++delta.numAddedNodes;
+        } else if (change == "edge" && myStream >> myEdge.start >> myEdge.end) {
+            delta.addedEdges.push_back(myEdge);
+        } else if (change == "-edge" && myStream >> myEdge.start >> myEdge.end) {
+            delta.removedEdges.push_back(myEdge);
+        } else if (change == "-node" && myStream >> node) {
+            delta.removedNodes.push_back(node);
+        } else {
+            return false;
+        }
+    }
+    return true;
+}
+
+
+/* Builds the next coarser level of a graph by matching. Nodes are visited from the lowest
+ * degree up, and each one not yet matched is merged with its unmatched neighbor of lowest
+ * degree (so hubs are left for last instead of swallowing everything early). A node whose
+ * neighbors were all matched joins the coarse node of its lowest-degree neighbor, which
+ * keeps stars and other hub-heavy graphs shrinking; isolated nodes stay on their own.
+ */
+GraphLevel coarsenGraph(size_t numNodes,const EdgeSpan& myEdges) {
+    std::vector<size_t> firstNeighbor;
+    std::vector<int> neighbors;
+    buildAdjacency(numNodes,myEdges,firstNeighbor,neighbors);
+    auto degree = [&](int node) { return firstNeighbor[node+1] - firstNeighbor[node]; };
+
+    std::vector<int> order(numNodes);
+    for (size_t i = 0; i < numNodes; ++i) {
+        order[i] = i;
+    }
+    std::stable_sort(order.begin(),order.end(),[&](int a,int b) { return degree(a) < degree(b); });
+
+    GraphLevel level;
+    level.numNodes = 0;
+    level.fineToCoarse.assign(numNodes,-1);
+    std::vector<int> leftOver;
+    for (int node : order) {
+        if (level.fineToCoarse[node] != -1) continue;
+        int partner = -1;
+        for (size_t n = firstNeighbor[node]; n < firstNeighbor[node+1]; ++n) {
+            int neighbor = neighbors[n];
+            if (neighbor == node || level.fineToCoarse[neighbor] != -1) continue;
+            if (partner == -1 || degree(neighbor) < degree(partner)) partner = neighbor;
+        }
+        if (partner == -1) {
+            leftOver.push_back(node);
+            continue;
+        }
+        level.fineToCoarse[node] = level.numNodes;
+        level.fineToCoarse[partner] = level.numNodes;
+        ++level.numNodes;
+    }
+    for (int node : leftOver) {
+        int joined = -1;
+        for (size_t n = firstNeighbor[node]; n < firstNeighbor[node+1]; ++n) {
+            int neighbor = neighbors[n];
+            if (neighbor == node || level.fineToCoarse[neighbor] == -1) continue;
+            if (joined == -1 || degree(neighbor) < degree(joined)) joined = neighbor;
+        }
+        level.fineToCoarse[node] = joined == -1 ? level.numNodes++ : level.fineToCoarse[joined];
+    }
+
+    //coarse edges: every fine edge between two different coarse nodes, once
+    for (size_t e = 0; e < myEdges.size(); ++e) {
+        Edge coarseEdge;
+        coarseEdge.start = level.fineToCoarse[myEdges.start(e)];
+        coarseEdge.end = level.fineToCoarse[myEdges.end(e)];
+        if (coarseEdge.start == coarseEdge.end) continue;
+        if (coarseEdge.start > coarseEdge.end) std::swap(coarseEdge.start,coarseEdge.end);
+        level.edges.push_back(coarseEdge);
+    }
+    auto edgeLess = [](const Edge& a,const Edge& b) {
+        return a.start < b.start || (a.start == b.start && a.end < b.end);
+    };
+    auto edgeEqual = [](const Edge& a,const Edge& b) { return a.start == b.start && a.end == b.end; };
+    std::sort(level.edges.begin(),level.edges.end(),edgeLess);
+    level.edges.erase(std::unique(level.edges.begin(),level.edges.end(),edgeEqual),level.edges.end());
+    return level;
+}
+
+
+/* Lists every node's neighbors (in both directions along the edges) in one array: the
+ * neighbors of node i are neighbors[firstNeighbor[i]] .. neighbors[firstNeighbor[i+1]-1]
+ */
+void buildAdjacency(size_t numNodes,const EdgeSpan& myEdges,std::vector<size_t>& firstNeighbor,std::vector<int>& neighbors) {
+    firstNeighbor.assign(numNodes+1,0);
+    for (size_t e = 0; e < myEdges.size(); ++e) {
+        ++firstNeighbor[myEdges.start(e)+1];
+        ++firstNeighbor[myEdges.end(e)+1];
+    }
+    for (size_t i = 0; i < numNodes; ++i) {
+        firstNeighbor[i+1] += firstNeighbor[i];
+    }
+    neighbors.resize(firstNeighbor[numNodes]);
+    std::vector<size_t> filled(firstNeighbor.begin(),firstNeighbor.end()-1);
+    for (size_t e = 0; e < myEdges.size(); ++e) {
+        neighbors[filled[myEdges.start(e)]++] = myEdges.end(e);
+        neighbors[filled[myEdges.end(e)]++] = myEdges.start(e);
+    }
+}
+
+
+/* Places the nodes of the finer graph below level around the coarse nodes they were merged
+ * into. The coarse layout is first spread out by sqrt(numFineNodes / level.numNodes), since
+ * edges have the same natural length at every level and so a graph's layout covers an area
+ * proportional to its number of nodes. The nodes merged into one coarse node go on a small
+ * sunflower spiral around it (golden-angle steps), so no two of them start on top of
+ * each other
+ */
+NodePositions interpolatePositions(const NodePositions& coarsePositions,const GraphLevel& level,size_t numFineNodes) {
+    const double kGoldenAngle = 2.39996322972865332;
+    const double kSpread = 0.1;
+    double scale = level.numNodes == 0 ? 1.0 : sqrt(double(numFineNodes) / double(level.numNodes));
+    std::vector<int> numPlaced(level.numNodes,0);
+    NodePositions positions;
+    positions.x.resize(numFineNodes);
+    positions.y.resize(numFineNodes);
+    for (size_t i = 0; i < numFineNodes; ++i) {
+        int parent = level.fineToCoarse[i];
+        int k = numPlaced[parent]++;
+        double radius = kSpread * sqrt(double(k+1));
+        positions.x[i] = scale * coarsePositions.x[parent] + radius * cos(kGoldenAngle * k);
+        positions.y[i] = scale * coarsePositions.y[parent] + radius * sin(kGoldenAngle * k);
+    }
+    return positions;
+}
+
+
+//Converts a graph file between the text and binary formats (whichever INPUT isn't in)
+int convertGraph(const string& inputName,const string& outputName) {
+    SimpleGraph myGraph;
+    EdgeSpan myEdges;
+    MappedFile input(inputName);
+    if (input.data == nullptr) {
+        std::cerr << "Couldn't open " << inputName << endl;
+        return 1;
+    }
+    bool isBinary = isBinaryGraph(input);
+    if (!loadMappedGraph(input,myGraph,myEdges)) return 1;
+    bool isWritten = isBinary ? writeTextGraph(outputName,myGraph.nodes.size(),myEdges)
+                              : writeBinaryGraph(outputName,myGraph.nodes.size(),myEdges);
+    if (!isWritten) {
+        std::cerr << "Couldn't write " << outputName << endl;
+        return 1;
+    }
+    cout << myGraph.nodes.size() << " nodes, " << myEdges.size() << " edges written to "
+         << outputName << (isBinary ? " (text)" : " (binary)") << endl;
+    return 0;
+}
+
+
+/* Reads a graph file in either format (the binary one is recognized by its header) into
+ * myGraph, edges included. The drawing code needs the graph's own edges, so a binary
+ * graph's are widened and copied out of the file here; runBatch uses loadMappedGraph
+ * instead, which doesn't copy them. Returns false, with the reason on cerr, if the file
+ * can't be opened or is malformed or an edge refers to a node that doesn't exist
+ */
+bool loadGraph(const string& fileName,SimpleGraph& myGraph) {
+    MappedFile input(fileName);
+    EdgeSpan myEdges;
+    if (input.data == nullptr || !loadMappedGraph(input,myGraph,myEdges)) return false;
+    if (myGraph.edges.empty()) {
+        myGraph.edges.resize(myEdges.size());
+        for (size_t e = 0; e < myEdges.size(); ++e) {
+            myGraph.edges[e] = myEdges[e];
+        }
+    }
+    return true;
+}
+
+
+//Whether a mapped graph file is in the binary format (which starts with kEdgeListMagic)
+bool isBinaryGraph(const MappedFile& input) {
+    return input.size >= sizeof(EdgeListHeader)
+            && memcmp(input.data,kEdgeListMagic,sizeof(kEdgeListMagic)) == 0;
+}
+
+
+/* Reads an open graph file in either format. myEdges is set to the graph's edges: for a
+ * binary file these are the int32 pairs in the mapping itself, which then has to stay
+ * open while they are used, and myGraph.edges is left empty; a text file is parsed into
+ * myGraph.edges and myEdges views those
+ */
+bool loadMappedGraph(const MappedFile& input,SimpleGraph& myGraph,EdgeSpan& myEdges) {
+    if (isBinaryGraph(input)) return parseBinaryGraph(input.data,input.size,myGraph,myEdges);
+    if (!parseTextGraph(input.data,input.size,myGraph)) return false;
+    myEdges = myGraph.edges;
+    return true;
+}
+
+
+/* Parses a text graph (number of nodes, then one "start end" pair per edge, separated by
+ * any whitespace) straight out of the mapped file with from_chars
+ */
+bool parseTextGraph(const char* text,size_t size,SimpleGraph& myGraph) {
+    const char* next = text;
+    const char* end = text + size;
+    auto skipSpace = [&]() {
+        while (next != end && isspace(static_cast<unsigned char>(*next))) ++next;
+    };
+
+    skipSpace();
+    int numNodes;
+    auto result = std::from_chars(next,end,numNodes);
+    if (result.ec != std::errc() || numNodes < 0) {
+        std::cerr << "The graph file doesn't start with a number of nodes" << endl;
+        return false;
+    }
+    next = result.ptr;
+
+    //one edge per line is usual, so the line count is a good guess at the edge count
+    std::vector<Edge> myEdges;
+    myEdges.reserve(std::count(next,end,'\n'));
+    while (true) {
+        skipSpace();
+        if (next == end) break;
+        long long ends[2];
+        for (long long& nodeIndex : ends) {
+            skipSpace();
+            result = std::from_chars(next,end,nodeIndex);
+            if (result.ec != std::errc()) {
+                std::cerr << "Expected a node index at byte " << (next - text)
+                          << " of the graph file" << endl;
+                return false;
+            }
+            next = result.ptr;
+        }
+        if (ends[0] < 0 || ends[1] < 0) {
+            std::cerr << "Edge " << myEdges.size() << " has a negative node index" << endl;
+            return false;
+        }
+        Edge myEdge;
+        myEdge.start = ends[0];
+        myEdge.end = ends[1];
+        if (!isValidEdge(myEdge,numNodes,myEdges.size())) return false;
+        myEdges.push_back(myEdge);
+    }
+    myGraph.nodes = nodeCreator(numNodes);
+    myGraph.edges = std::move(myEdges);
+    return true;
+}
+
+
+/* Reads a binary edge list in place: its int32 node indices are checked and myEdges is
+ * pointed at them, without copying them into myGraph.edges
+ */
+bool parseBinaryGraph(const char* image,size_t size,SimpleGraph& myGraph,EdgeSpan& myEdges) {
+    EdgeListHeader header;
+    memcpy(&header,image,sizeof(header));
+    if (header.numNodes < 0 || header.numEdges < 0
+            || uint64_t(header.numEdges) != (size - sizeof(header)) / (2*sizeof(int32_t))
+            || (size - sizeof(header)) % (2*sizeof(int32_t)) != 0) {
+        std::cerr << "The binary graph file's header doesn't match its size" << endl;
+        return false;
+    }
+    const int32_t* ends = reinterpret_cast<const int32_t*>(image + sizeof(header));
+    EdgeSpan mappedEdges(ends,header.numEdges);
+    for (size_t e = 0; e < mappedEdges.size(); ++e) {
+        if (ends[2*e] < 0 || ends[2*e+1] < 0) {
+            std::cerr << "Edge " << e << " has a negative node index" << endl;
+            return false;
+        }
+        if (!isValidEdge(mappedEdges[e],header.numNodes,e)) return false;
+    }
+    myGraph.nodes = nodeCreator(header.numNodes);
+    myGraph.edges.clear();
+    myEdges = mappedEdges;
+    return true;
+}
+
+
+//Checks that both ends of an edge are nodes of the graph (reporting the edge on cerr if not)
+bool isValidEdge(const Edge& myEdge,size_t numNodes,size_t edgeIndex) {
+    if (myEdge.start < numNodes && myEdge.end < numNodes) return true;
+    std::cerr << "Edge " << edgeIndex << " (" << myEdge.start << ", " << myEdge.end
+              << ") refers to a node that doesn't exist; the graph has " << numNodes << " nodes" << endl;
+    return false;
+}
+
+
+//Writes a graph in the text format
+bool writeTextGraph(const string& fileName,size_t numNodes,const EdgeSpan& myEdges) {
+    std::ofstream myStream(fileName);
+    myStream << numNodes << '\n';
+    for (size_t e = 0; e < myEdges.size(); ++e) {
+        myStream << myEdges.start(e) << ' ' << myEdges.end(e) << '\n';
+    }
+    myStream.close();
+    return !myStream.fail();
+}
+
+
+//Writes a graph in the binary edge-list format; false if it has too many nodes for int32 indices
+bool writeBinaryGraph(const string& fileName,size_t numNodes,const EdgeSpan& myEdges) {
+    if (numNodes > size_t(INT32_MAX)) return false;
+    EdgeListHeader header;
+    memcpy(header.magic,kEdgeListMagic,sizeof(kEdgeListMagic));
+    header.numNodes = numNodes;
+    header.numEdges = myEdges.size();
+    std::vector<int32_t> ends;
+    ends.reserve(2*myEdges.size());
+    for (size_t e = 0; e < myEdges.size(); ++e) {
+        ends.push_back(myEdges.start(e));
+        ends.push_back(myEdges.end(e));
+    }
+    std::ofstream myStream(fileName,std::ios::binary);
+    myStream.write(reinterpret_cast<const char*>(&header),sizeof(header));
+    myStream.write(reinterpret_cast<const char*>(ends.data()),ends.size()*sizeof(int32_t));
+    myStream.close();
+    return !myStream.fail();
+}
+
+
+MappedFile::MappedFile(const string& fileName) {
+#ifndef _WIN32
+    int fd = open(fileName.c_str(),O_RDONLY);
+    if (fd < 0) return;
+    struct stat info;
+    if (fstat(fd,&info) != 0) {
+        close(fd);
+        return;
+    }
+    size = info.st_size;
+    if (size == 0) {
+        close(fd);
+        data = "";
+        return;
+    }
+    void* image = mmap(nullptr,size,PROT_READ,MAP_PRIVATE,fd,0);
+    close(fd);
+    if (image == MAP_FAILED) {
+        size = 0;
+        return;
+    }
+    mapped = image;
+    data = static_cast<const char*>(image);
+#else
+    std::ifstream myStream(fileName,std::ios::binary | std::ios::ate);
+    if (!myStream) return;
+    owned.resize(myStream.tellg());
+    myStream.seekg(0);
+    myStream.read(owned.data(),owned.size());
+    if (!myStream) return;
+    size = owned.size();
+    data = owned.empty() ? "" : owned.data();
+#endif
+}
+
+
+MappedFile::~MappedFile() {
+#ifndef _WIN32
+    if (mapped != nullptr) munmap(mapped,size);
+#endif
+}
+
+
+//Writes the number of nodes, then each node's "x y" on its own line, at full precision
+bool writeLayout(const string& fileName,const NodePositions& positions) {
+    std::ofstream myStream(fileName);
+    myStream << positions.x.size() << '\n';
+    myStream << std::setprecision(17);
+    for (size_t i = 0; i < positions.x.size(); ++i) {
+        myStream << positions.x[i] << ' ' << positions.y[i] << '\n';
+    }
+    myStream.close();
+    return !myStream.fail();
+}
+
+
 //Prints a message to the console welcoming the user and describing the program.
 void Welcome() {
     cout << "Welcome to CS106L GraphViz!" << endl;
@@ -95,20 +1262,19 @@ void Welcome() {
 }
 
 
-/* This function prompts the user for a file name, then opens the file and makes sure it's valid.
- * Will reprompt if the file does not exist (similar to code found in course reader)
+/* This function prompts the user for a file name, then loads the graph in it (see loadGraph).
+ * Will reprompt if the file does not exist or isn't a valid graph (similar to code found in course reader)
  */
-std::ifstream streamCreator() {
-    std::ifstream myStream;
+SimpleGraph graphCreator() {
+    SimpleGraph myGraph;
     while(true) {
         string fileName;
         std::getline(cin,fileName);
-        myStream.open(fileName);
-        if (myStream) break;
-        std::cerr << "Couldn't open the file!" << endl;
+        if (loadGraph(fileName,myGraph)) break;
+        std::cerr << "Couldn't load a graph from that file!" << endl;
         cout << "Please enter a valid input file name\n> ";
     }
-    return myStream;
+    return myGraph;
 }
 
 
@@ -142,83 +1308,498 @@ string GetLine() {
 
 /* Uses the number of nodes given to create Node, places nodes along the unit circle, and
  * pushes Node structs into a vector<Node>
+ * Each node is the previous one rotated by 2pi/numNodes, which saves a cos and a sin per
+ * node; every kExactEvery-th node is computed directly so rounding errors can't build up
  */
 std::vector<Node> nodeCreator(const int numNodes) {
     const double kPi = 3.14159265358979323;
+    const int kExactEvery = 1024;
+    const double cosStep = cos(2*kPi/double(numNodes));
+    const double sinStep = sin(2*kPi/double(numNodes));
     std::vector<Node> myVectorNode;
+    myVectorNode.reserve(numNodes);
+    Node myNode;
     for (int i=0; i<numNodes; ++i) {
-        Node myNode;
-        myNode.x = cos((2*kPi*double(i))/double(numNodes));
-        myNode.y = sin((2*kPi*double(i))/double(numNodes));
+        if (i % kExactEvery == 0) {
+            myNode.x = cos((2*kPi*double(i))/double(numNodes));
+            myNode.y = sin((2*kPi*double(i))/double(numNodes));
+        } else {
+            Node previous = myNode;
+            myNode.x = previous.x*cosStep - previous.y*sinStep;
+            myNode.y = previous.x*sinStep + previous.y*cosStep;
+        }
         myVectorNode.push_back(myNode);
     }
     return myVectorNode;
 }
 
 
-//Reads the input stream to create Edge structs. Pushes Edge structs into a vector<Edge>
-std::vector<Edge> edgeCreator(std::ifstream& myStream) {
-    std::vector<Edge> myEdgeVector;
-    int leftEdge;
-    int rightEdge;
-    while (myStream >> leftEdge >> rightEdge) {
-        Edge myEdge;
-        myEdge.start = leftEdge;
-        myEdge.end = rightEdge;
-        myEdgeVector.push_back(myEdge);
+//Copies the nodes' positions into a structure of arrays
+NodePositions positionsOf(const SimpleGraph& myGraph) {
+    NodePositions positions;
+    positions.x.reserve(myGraph.nodes.size());
+    positions.y.reserve(myGraph.nodes.size());
+    for (const Node& myNode : myGraph.nodes) {
+        positions.x.push_back(myNode.x);
+        positions.y.push_back(myNode.y);
+    }
+    return positions;
+}
+
+
+//Copies positions back into the graph's nodes (before drawing it)
+void storePositions(const NodePositions& positions,SimpleGraph& myGraph) {
+    for (size_t i = 0; i < myGraph.nodes.size(); ++i) {
+        myGraph.nodes[i].x = positions.x[i];
+        myGraph.nodes[i].y = positions.y[i];
+    }
+}
+
+
+/* Adds up one iteration's forces on every node (repulsion, exact or Barnes-Hut as the
+ * options say, plus attraction along the edges) in nodeDelX and nodeDelY, using the
+ * workers' threads. Barnes-Hut rows are independent, so each thread writes its own rows
+ * directly. Exact pairs and edges share nodes across any split, so each thread adds its
+ * rows' pairs (split so every thread gets about as many, see pairSplitRow) and its share
+ * of the edges into its own accumulator, and the accumulators are then summed node by
+ * node in thread order. The result is the same from run to run for a given number of
+ * threads, but the sums are taken in a different order for different numbers of threads
+ * (and one thread adds straight into nodeDelX), so the layouts differ in the last bits
+ */
+void calculateForces(const EdgeSpan& myEdges,const NodePositions& positions,std::vector<double>& nodeDelX,std::vector<double>& nodeDelY,const LayoutOptions& options,ForceWorkers& workers) {
+    const size_t numNodes = positions.x.size();
+    const bool approximate = usesBarnesHut(options,numNodes);
+    const int numThreads = workers.numThreads();
+    std::vector<QuadCell> cells;
+    if (approximate) cells = buildQuadtree(positions);
+
+    if (numThreads == 1) {
+        if (approximate) {
+            repelRowsBarnesHut(cells,positions,nodeDelX,nodeDelY,options.theta,0,numNodes);
+        } else {
+            repelRows(positions,nodeDelX,nodeDelY,0,numNodes);
+        }
+        attractEdges(myEdges,positions,nodeDelX,nodeDelY,0,myEdges.size());
+        return;
+    }
+
+    workers.accX.resize(numThreads);
+    workers.accY.resize(numThreads);
+    workers.run([&](int part) {
+        size_t firstRow = numNodes*part/numThreads;
+        size_t lastRow = numNodes*(part+1)/numThreads;
+        workers.accX[part].resize(numNodes,0.0);
+        workers.accY[part].resize(numNodes,0.0);
+        if (approximate) {
+            repelRowsBarnesHut(cells,positions,nodeDelX,nodeDelY,options.theta,firstRow,lastRow);
+        } else {
+            repelRows(positions,workers.accX[part],workers.accY[part],
+                      pairSplitRow(numNodes,part,numThreads),pairSplitRow(numNodes,part+1,numThreads));
+        }
+        size_t firstEdge = myEdges.size()*part/numThreads;
+        size_t lastEdge = myEdges.size()*(part+1)/numThreads;
+        attractEdges(myEdges,positions,workers.accX[part],workers.accY[part],firstEdge,lastEdge);
+    });
+
+    //reduction: each thread owns a slice of the nodes, sums the accumulators in order and
+    //zeroes them for the next iteration
+    workers.run([&](int part) {
+        size_t last = numNodes*(part+1)/numThreads;
+        for (int t = 0; t < numThreads; ++t) {
+            std::vector<double>& accX = workers.accX[t];
+            std::vector<double>& accY = workers.accY[t];
+            for (size_t i = numNodes*part/numThreads; i < last; ++i) {
+                nodeDelX[i] += accX[i];
+                nodeDelY[i] += accY[i];
+                accX[i] = 0.0;
+                accY[i] = 0.0;
+            }
+        }
+    });
+}
+
+
+//Whether a layout of numNodes nodes computes repulsion with Barnes-Hut (see LayoutOptions)
+bool usesBarnesHut(const LayoutOptions& options,size_t numNodes) {
+    if (options.repulsion == AUTO_REPULSION) return numNodes > kMaxExactNodes;
+    return options.repulsion == BARNES_HUT_REPULSION;
+}
+
+
+ForceWorkers::ForceWorkers(int numThreads) {
+    for (int part = 1; part < numThreads; ++part) {
+        helpers.emplace_back(&ForceWorkers::work,this,part);
+    }
+}
+
+
+ForceWorkers::~ForceWorkers() {
+    {
+        std::lock_guard<std::mutex> guard(lock);
+        isStopping = true;
+    }
+    wake.notify_all();
+    for (std::thread& helper : helpers) {
+        helper.join();
+    }
+}
+
+
+//Runs task(0) .. task(numThreads()-1) at the same time; task(0) runs on the calling thread
+void ForceWorkers::run(const std::function<void(int)>& myTask) {
+    if (helpers.empty()) {
+        myTask(0);
+        return;
+    }
+    {
+        std::lock_guard<std::mutex> guard(lock);
+        task = &myTask;
+        numRunning = helpers.size();
+        ++generation;
+    }
+    wake.notify_all();
+    myTask(0);
+    std::unique_lock<std::mutex> guard(lock);
+    finished.wait(guard,[&]() { return numRunning == 0; });
+    task = nullptr;
+}
+
+
+//A helper thread's loop: waits for each task handed out by run and does its part of it
+void ForceWorkers::work(int part) {
+    long long done = 0;
+    while (true) {
+        const std::function<void(int)>* myTask;
+        {
+            std::unique_lock<std::mutex> guard(lock);
+            wake.wait(guard,[&]() { return isStopping || generation != done; });
+            if (isStopping) return;
+            done = generation;
+            myTask = task;
+        }
+        (*myTask)(part);
+        std::lock_guard<std::mutex> guard(lock);
+        if (--numRunning == 0) finished.notify_one();
+    }
+}
+
+
+/* Exact repulsive forces between the pairs of nodes (i, j) with firstRow <= i < lastRow and
+ * j > i, added to delX and delY of both nodes. Each pair is visited once and pushes both
+ * nodes apart with twice the force, which is what the layout has always used (every pair
+ * used to be visited in both orders). A force of k/d along the unit vector (dx/d, dy/d)
+ * is k*dx/d^2, so no square root or trig call is needed; with AVX2 the inner loop handles
+ * four partners j at a time.
+ */
+void repelRows(const NodePositions& positions,std::vector<double>& nodeDelX,std::vector<double>& nodeDelY,size_t firstRow,size_t lastRow) {
+    const double k_repel = 0.001;
+    const size_t numNodes = positions.x.size();
+    const double* posX = positions.x.data();
+    const double* posY = positions.y.data();
+    double* delX = nodeDelX.data();
+    double* delY = nodeDelY.data();
+
+    for (size_t i = firstRow; i < lastRow; ++i) {
+        double sumX = 0.0;
+        double sumY = 0.0;
+        size_t j = i+1;
+
+#ifdef __AVX2__
+        const __m256d nodeX = _mm256_set1_pd(posX[i]);
+        const __m256d nodeY = _mm256_set1_pd(posY[i]);
+        const __m256d strength = _mm256_set1_pd(2 * k_repel);
+        __m256d accX = _mm256_setzero_pd();
+        __m256d accY = _mm256_setzero_pd();
+        for (; j+4 <= numNodes; j += 4) {
+            __m256d dx = _mm256_sub_pd(_mm256_loadu_pd(posX+j),nodeX);
+            __m256d dy = _mm256_sub_pd(_mm256_loadu_pd(posY+j),nodeY);
+            __m256d dist2 = _mm256_add_pd(_mm256_mul_pd(dx,dx),_mm256_mul_pd(dy,dy));
+            __m256d scale = _mm256_div_pd(strength,dist2);
+            __m256d forceX = _mm256_mul_pd(scale,dx);
+            __m256d forceY = _mm256_mul_pd(scale,dy);
+            accX = _mm256_add_pd(accX,forceX);
+            accY = _mm256_add_pd(accY,forceY);
+            _mm256_storeu_pd(delX+j,_mm256_add_pd(_mm256_loadu_pd(delX+j),forceX));
+            _mm256_storeu_pd(delY+j,_mm256_add_pd(_mm256_loadu_pd(delY+j),forceY));
+        }
+        double lanesX[4];
+        double lanesY[4];
+        _mm256_storeu_pd(lanesX,accX);
+        _mm256_storeu_pd(lanesY,accY);
+        sumX = (lanesX[0] + lanesX[1]) + (lanesX[2] + lanesX[3]);
+        sumY = (lanesY[0] + lanesY[1]) + (lanesY[2] + lanesY[3]);
+#endif
+
+        //scalar loop (the last few partners with AVX2, all of them without)
+        for (; j < numNodes; ++j) {
+            double dx = posX[j] - posX[i];
+            double dy = posY[j] - posY[i];
+            double scale = 2 * k_repel / (dx*dx + dy*dy);
+            sumX += scale * dx;
+            sumY += scale * dy;
+            delX[j] += scale * dx;
+            delY[j] += scale * dy;
+        }
+        delX[i] -= sumX;
+        delY[i] -= sumY;
+    }
+}
+
+
+/* The first row of part part when the numNodes rows of repelRows are split into numParts
+ * parts with about as many pairs each. Row i has numNodes-1-i pairs, so the rows from r
+ * on hold about (numNodes-r)^2/2 of them
+ */
+size_t pairSplitRow(size_t numNodes,int part,int numParts) {
+    double rowsLeft = numNodes * sqrt(1.0 - double(part)/numParts);
+    return numNodes - std::min(numNodes,size_t(rowsLeft + 0.5));
+}
+
+
+/* Barnes-Hut repulsion, O(n log n) instead of O(n^2), on nodes firstRow .. lastRow-1
+ * given the quadtree over all nodes: while adding up the forces on a node, any cell whose
+ * size is less than theta times its distance to the node counts as a single body of the
+ * cell's mass at its center of mass. Only those nodes' entries of nodeDelX and nodeDelY
+ * are written
+ */
+void repelRowsBarnesHut(const std::vector<QuadCell>& cells,const NodePositions& positions,std::vector<double>& nodeDelX,std::vector<double>& nodeDelY,double theta,size_t firstRow,size_t lastRow) {
+    std::vector<int> pending;
+    for (size_t i = firstRow; i < lastRow; ++i) {
+        repelFromQuadtree(cells,positions.x[i],positions.y[i],i,theta,nodeDelX[i],nodeDelY[i],pending);
     }
-    return myEdgeVector;
 }
 
 
-//Calculates repulsive forces between nodes. Keeps track of delX and delY for each node
-void calculateRepulsiveForces(const SimpleGraph& myGraph,std::vector<double>& nodePosX,std::vector<double>& nodePosY) {
+/* Adds the Barnes-Hut repulsion on a point at (x, y) from the nodes in the quadtree to
+ * delX and delY, leaving out node self (-1 if the point isn't one of the tree's nodes).
+ * pending is scratch space for the cells still to visit
+ */
+void repelFromQuadtree(const std::vector<QuadCell>& cells,double x,double y,int self,double theta,double& delX,double& delY,std::vector<int>& pending) {
     double k_repel = 0.001;
-    auto myNodes = myGraph.nodes;
-    for (size_t i = 0; i<myNodes.size(); ++i) {
-        for (size_t j = 0; j<myNodes.size(); ++j) {
-            if (i==j) continue;
+    if (cells.empty()) return;
+    pending.push_back(0);
+    while (!pending.empty()) {
+        const QuadCell& cell = cells[pending.back()];
+        pending.pop_back();
+        if (cell.mass == 0 || cell.body == self) continue;
+
+        double dx = cell.massX - x;
+        double dy = cell.massY - y;
+        double dist = sqrt(dx*dx + dy*dy);
+
+        //far enough away (or nothing left to open): push away from the whole cell
+        if (cell.firstChild == -1 || cell.size < theta*dist) {
+            if (dist == 0.0) continue;
+            double Frepel = 2 * k_repel * cell.mass / dist;
+            delX -= Frepel * dx / dist;
+            delY -= Frepel * dy / dist;
+        } else {
+            for (int child = 0; child < 4; ++child) {
+                pending.push_back(cell.firstChild + child);
+            }
+        }
+    }
+}
+
+
+//Builds the Barnes-Hut quadtree over the nodes' current positions; cell 0 is the root
+std::vector<QuadCell> buildQuadtree(const NodePositions& positions) {
+    std::vector<QuadCell> cells;
+    if (positions.x.empty()) return cells;
+
+    //root cell: smallest square around all nodes
+    auto rangeX = std::minmax_element(positions.x.begin(),positions.x.end());
+    auto rangeY = std::minmax_element(positions.y.begin(),positions.y.end());
+    double minX = *rangeX.first, maxX = *rangeX.second;
+    double minY = *rangeY.first, maxY = *rangeY.second;
+    cells.reserve(2*positions.x.size() + 1);
+    cells.push_back({minX,minY,std::max(maxX-minX,maxY-minY),0.0,0.0,0,-1,-1});
+
+    std::vector<int> bodies(positions.x.size());
+    for (size_t i = 0; i < bodies.size(); ++i) {
+        bodies[i] = i;
+    }
+    fillQuadCell(cells,0,positions,bodies,0,bodies.size(),0);
+    return cells;
+}
+
+
+/* Fills in a quadtree cell for the nodes bodies[first..last), splitting it into four
+ * children (and sorting those nodes into them) while it holds more than one node
+ */
+void fillQuadCell(std::vector<QuadCell>& cells,int cell,const NodePositions& positions,std::vector<int>& bodies,size_t first,size_t last,int depth) {
+    double sumX = 0.0, sumY = 0.0;
+    for (size_t b = first; b < last; ++b) {
+        sumX += positions.x[bodies[b]];
+        sumY += positions.y[bodies[b]];
+    }
+    cells[cell].mass = last - first;
+    if (last == first) return;
+    cells[cell].massX = sumX / double(last - first);
+    cells[cell].massY = sumY / double(last - first);
+    if (last - first == 1) {
+        cells[cell].body = bodies[first];
+        return;
+    }
+    if (depth == kMaxQuadDepth) return;
+
+    //split into quadrants: x halves first, then each half by y
+    double half = cells[cell].size / 2;
+    double midX = cells[cell].minX + half;
+    double midY = cells[cell].minY + half;
+    auto isLeft = [&](int body) { return positions.x[body] < midX; };
+    auto isBelow = [&](int body) { return positions.y[body] < midY; };
+    size_t splitX = std::partition(bodies.begin()+first,bodies.begin()+last,isLeft) - bodies.begin();
+    size_t splitLeft = std::partition(bodies.begin()+first,bodies.begin()+splitX,isBelow) - bodies.begin();
+    size_t splitRight = std::partition(bodies.begin()+splitX,bodies.begin()+last,isBelow) - bodies.begin();
+
+    int firstChild = cells.size();
+    double minX = cells[cell].minX, minY = cells[cell].minY;
+    cells[cell].firstChild = firstChild;
+    cells.push_back({minX,minY,half,0.0,0.0,0,-1,-1});
+    cells.push_back({minX,midY,half,0.0,0.0,0,-1,-1});
+    cells.push_back({midX,minY,half,0.0,0.0,0,-1,-1});
+    cells.push_back({midX,midY,half,0.0,0.0,0,-1,-1});
+    fillQuadCell(cells,firstChild,positions,bodies,first,splitLeft,depth+1);
+    fillQuadCell(cells,firstChild+1,positions,bodies,splitLeft,splitX,depth+1);
+    fillQuadCell(cells,firstChild+2,positions,bodies,splitX,splitRight,depth+1);
+    fillQuadCell(cells,firstChild+3,positions,bodies,splitRight,last,depth+1);
+}
 
-            double Frepel = k_repel / sqrt ( pow(myNodes[j].y-myNodes[i].y,2) +
-                                           pow(myNodes[j].x-myNodes[i].x,2));
 
-            double theta = atan2(myNodes[j].y-myNodes[i].y,
-                                 myNodes[j].x-myNodes[i].x);
+//Which of a split cell's four children (in the order fillQuadCell makes them) holds (x, y)
+int quadrantOf(const QuadCell& cell,double x,double y) {
+    double half = cell.size / 2;
+    return (x < cell.minX + half ? 0 : 2) + (y < cell.minY + half ? 0 : 1);
+}
 
-            nodePosX[i] -= Frepel * cos(theta);
-            nodePosY[i] -= Frepel * sin(theta);
-            nodePosX[j] += Frepel * cos(theta);
-            nodePosY[j] += Frepel * sin(theta);
+
+/* Takes a node out of the quadtree, which must hold it at its position in positions: every
+ * cell on the way down to it loses it from its mass and center of mass. Cells left empty
+ * stay in the tree with a mass of 0
+ */
+void removeFromQuadtree(std::vector<QuadCell>& cells,const NodePositions& positions,int node) {
+    double x = positions.x[node], y = positions.y[node];
+    int cell = cells.empty() ? -1 : 0;
+    while (cell != -1) {
+        QuadCell& myCell = cells[cell];
+        if (myCell.mass <= 1) {
+            myCell.mass = 0;
+            myCell.body = -1;
+        } else {
+            myCell.massX = (myCell.massX * myCell.mass - x) / (myCell.mass - 1);
+            myCell.massY = (myCell.massY * myCell.mass - y) / (myCell.mass - 1);
+            --myCell.mass;
         }
+        cell = myCell.firstChild == -1 ? -1 : myCell.firstChild + quadrantOf(myCell,x,y);
     }
 }
 
 
-//Calculates attractive forces between nodes connected by edges. Keeps track of delX and delY for each node
-void calculateAttractiveForces(const SimpleGraph& myGraph,std::vector<double>& nodePosX,std::vector<double>& nodePosY) {
-    double k_attract = 0.001;
-    auto myNodes = myGraph.nodes;
-    auto myEdges = myGraph.edges;
-    for (size_t i = 0; i < myEdges.size(); ++i) {
-        Node startNode = myNodes[myEdges[i].start];
-        Node endNode = myNodes[myEdges[i].end];
+/* Adds a node, at its position in positions, to the quadtree: every cell on the way down
+ * gains it, and a leaf already holding a node is split (as in fillQuadCell) until the two
+ * are apart. A node outside the root cell first doubles the root, as often as it takes,
+ * with the old root as one of the new root's children. Returns false, changing nothing,
+ * if the tree is empty or its root has no size to double
+ */
+bool insertIntoQuadtree(std::vector<QuadCell>& cells,const NodePositions& positions,int node) {
+    double x = positions.x[node], y = positions.y[node];
+    if (cells.empty() || !(cells[0].size > 0.0)) return false;
+    while (x < cells[0].minX || y < cells[0].minY
+            || x > cells[0].minX + cells[0].size || y > cells[0].minY + cells[0].size) {
+        QuadCell oldRoot = cells[0];
+        QuadCell& root = cells[0];
+        root.minX = x < oldRoot.minX ? oldRoot.minX - oldRoot.size : oldRoot.minX;
+        root.minY = y < oldRoot.minY ? oldRoot.minY - oldRoot.size : oldRoot.minY;
+        root.size = 2 * oldRoot.size;
+        root.body = -1;
+        root.firstChild = cells.size();
+        int oldQuadrant = quadrantOf(root,oldRoot.minX,oldRoot.minY);
+        QuadCell newRoot = root;
+        for (int child = 0; child < 4; ++child) {
+            double half = oldRoot.size;
+            QuadCell quadrant = {newRoot.minX + (child >= 2 ? half : 0.0),newRoot.minY + (child % 2 == 1 ? half : 0.0),half,0.0,0.0,0,-1,-1};
+            cells.push_back(child == oldQuadrant ? oldRoot : quadrant);
+        }
+    }
 
-        double Fattract = k_attract*(pow(endNode.y-startNode.y,2)+pow(endNode.x-startNode.x,2));
-        double theta = atan2(endNode.y-startNode.y,endNode.x-startNode.x);
+    int cell = 0;
+    for (int depth = 0; ; ++depth) {
+        int mass = cells[cell].mass;
+        cells[cell].massX = (cells[cell].massX * mass + x) / (mass + 1);
+        cells[cell].massY = (cells[cell].massY * mass + y) / (mass + 1);
+        cells[cell].mass = mass + 1;
+        if (cells[cell].firstChild == -1) {
+            int resident = cells[cell].body;
+            if (mass == 0) {
+                cells[cell].body = node;
+                return true;
+            }
+            if (depth >= kMaxQuadDepth || resident == -1) {
+                cells[cell].body = -1;
+                return true;
+            }
 
-        nodePosX[myEdges[i].start] += Fattract * cos(theta);
-        nodePosY[myEdges[i].start] += Fattract * sin(theta);
-        nodePosX[myEdges[i].end] -= Fattract * cos(theta);
-        nodePosY[myEdges[i].end] -= Fattract * sin(theta);
+            //split the leaf, moving the node already in it down into its quadrant
+            QuadCell leaf = cells[cell];
+            double half = leaf.size / 2;
+            int firstChild = cells.size();
+            cells[cell].firstChild = firstChild;
+            cells[cell].body = -1;
+            cells.push_back({leaf.minX,leaf.minY,half,0.0,0.0,0,-1,-1});
+            cells.push_back({leaf.minX,leaf.minY+half,half,0.0,0.0,0,-1,-1});
+            cells.push_back({leaf.minX+half,leaf.minY,half,0.0,0.0,0,-1,-1});
+            cells.push_back({leaf.minX+half,leaf.minY+half,half,0.0,0.0,0,-1,-1});
+            QuadCell& home = cells[firstChild + quadrantOf(leaf,positions.x[resident],positions.y[resident])];
+            home.mass = 1;
+            home.massX = positions.x[resident];
+            home.massY = positions.y[resident];
+            home.body = resident;
+        }
+        cell = cells[cell].firstChild + quadrantOf(cells[cell],x,y);
     }
 }
 
 
-//Updates the positions of all nodes according to the net forces (repulsive and attractive)
-void moveNodes(SimpleGraph& myGraph,std::vector<double>& nodePosX,std::vector<double>& nodePosY) {
+/* Attractive forces along the edges myEdges[firstEdge] .. myEdges[lastEdge-1], added to
+ * delX and delY of both ends. A force of k*d^2 along (dx/d, dy/d) is k*d*dx, so one
+ * square root per edge replaces the trig calls. Edges share endpoints in no particular
+ * order, so this loop stays scalar
+ */
+void attractEdges(const EdgeSpan& myEdges,const NodePositions& positions,std::vector<double>& nodeDelX,std::vector<double>& nodeDelY,size_t firstEdge,size_t lastEdge) {
+    const double k_attract = 0.001;
+    for (size_t e = firstEdge; e < lastEdge; ++e) {
+        Edge myEdge = myEdges[e];
+        double dx = positions.x[myEdge.end] - positions.x[myEdge.start];
+        double dy = positions.y[myEdge.end] - positions.y[myEdge.start];
+        double scale = k_attract * sqrt(dx*dx + dy*dy);
 
-    for (size_t i = 0; i < nodePosX.size(); ++i) {
-        myGraph.nodes[i].x += nodePosX[i];
-        myGraph.nodes[i].y += nodePosY[i];
+        nodeDelX[myEdge.start] += scale * dx;
+        nodeDelY[myEdge.start] += scale * dy;
+        nodeDelX[myEdge.end] -= scale * dx;
+        nodeDelY[myEdge.end] -= scale * dy;
+    }
+}
+
+
+/* Updates the positions of all nodes according to the net forces (repulsive and attractive)
+ * A node whose move would be longer than maxStep moves maxStep in the same direction.
+ * Returns the total distance all nodes moved
+ */
+double moveNodes(NodePositions& positions,const std::vector<double>& nodeDelX,const std::vector<double>& nodeDelY,double maxStep) {
+    double displacement = 0.0;
+    for (size_t i = 0; i < nodeDelX.size(); ++i) {
+        double delX = nodeDelX[i];
+        double delY = nodeDelY[i];
+        double step = sqrt(delX*delX + delY*delY);
+        if (step > maxStep) {
+            delX *= maxStep / step;
+            delY *= maxStep / step;
+            step = maxStep;
+        }
+        positions.x[i] += delX;
+        positions.y[i] += delY;
+        displacement += step;
     }
+    return displacement;
 }